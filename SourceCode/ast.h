@@ -0,0 +1,48 @@
+/*
+    File: ast.h
+    Author: Jiaqi Li
+    The abstract syntax tree (AST) for the Simplified C compiler, used in AST mode.
+
+    In AST mode the reductions only build the tree, and the code is generated by a separate pass over it.
+    The nodes live in one contiguous array and are referred to by their 32-bit index.
+    The children of each node are stored contiguously in another array.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "parser.h"
+
+struct AstNode {
+    semantic_action action;     // the routine of the reduced production rule
+    bool is_terminal;
+    uint32_t first_child;       // index of the first child in `Ast::children`
+    uint32_t child_count;
+    uint32_t text;              // only terminal has this, index into `Ast::texts`
+};
+
+class Ast {
+public:
+    std::vector<AstNode> nodes;
+    std::vector<uint32_t> children;
+    std::vector<std::string> texts;
+
+    uint32_t add_terminal(const std::string& text) {
+        texts.push_back(text);
+        nodes.push_back(AstNode{ACT_AUTO_COPY, true, 0, 0, (uint32_t)texts.size() - 1});
+        return nodes.size() - 1;
+    }
+
+    uint32_t add_node(semantic_action action, const std::vector<uint32_t>& child_nodes) {
+        nodes.push_back(AstNode{action, false, (uint32_t)children.size(), (uint32_t)child_nodes.size(), 0});
+        children.insert(children.end(), child_nodes.begin(), child_nodes.end());
+        return nodes.size() - 1;
+    }
+
+    uint32_t child(uint32_t node, int i) const {
+        return children[nodes[node].first_child + i];
+    }
+};
@@ -0,0 +1,213 @@
+/*
+    File: cfg.cpp
+    Author: Jiaqi Li
+    The control-flow graph of the IR program
+*/
+
+#include "cfg.h"
+
+using namespace std;
+
+ControlFlowGraph::ControlFlowGraph(const vector<IRInst>& code) : code(code) {
+    int size = code.size();
+    for (int i = 0; i < size; i++) {
+        if (code[i].op == IR_LABEL) {
+            if (code[i].a.value >= (int)label_position.size()) {
+                label_position.resize(code[i].a.value + 1, -1);
+            }
+            label_position[code[i].a.value] = i;
+        }
+    }
+
+    // the blocks
+    block_of.assign(size, -1);
+    for (int i = 0; i < size; i++) {
+        bool leader = i == 0 || code[i].op == IR_LABEL || ir_jump_target(code[i - 1]) >= 0 || code[i - 1].op == IR_RETURN;
+        if (leader) {
+            blocks.push_back(BasicBlock{i, i + 1, {}, {}});
+        } else {
+            blocks.back().end = i + 1;
+        }
+        block_of[i] = blocks.size() - 1;
+    }
+    for (int b = 0; b < (int)blocks.size(); b++) {
+        for (int next : next_instructions(blocks[b].end - 1)) {
+            if (next < size) {
+                blocks[b].successors.push_back(block_of[next]);
+                blocks[block_of[next]].predecessors.push_back(b);
+            }
+        }
+    }
+
+    // the loops, from the backward jumps and branches
+    vector<int> loop_end(size, -1);
+    for (int i = 0; i < size; i++) {
+        int target = ir_jump_target(code[i]);
+        if (target >= 0 && label_position[target] <= i) {
+            loop_end[label_position[target]] = i;
+        }
+    }
+    for (int i = 0; i < size; i++) {
+        if (loop_end[i] >= 0) {
+            loops.push_back(IRLoop{i, loop_end[i]});
+        }
+    }
+
+    compute_dominators();
+}
+
+void ControlFlowGraph::compute_dominators() {
+    int count = blocks.size();
+    immediate_dominator.assign(count, -1);
+    dominated.assign(count, {});
+    if (count == 0) {
+        return;
+    }
+
+    // the postorder of a depth-first search from the first block
+    vector<int> postorder;
+    vector<bool> visited(count, false);
+    vector<pair<int, int>> pending = {{0, 0}};     // the block, and its next successor to visit
+    visited[0] = true;
+    while (!pending.empty()) {
+        int b = pending.back().first;
+        int& next = pending.back().second;
+        if (next < (int)blocks[b].successors.size()) {
+            int successor = blocks[b].successors[next++];
+            if (!visited[successor]) {
+                visited[successor] = true;
+                pending.push_back({successor, 0});
+            }
+        } else {
+            postorder.push_back(b);
+            pending.pop_back();
+        }
+    }
+    reverse_postorder.assign(postorder.rbegin(), postorder.rend());
+    vector<int> order(count, -1);
+    for (int i = 0; i < (int)reverse_postorder.size(); i++) {
+        order[reverse_postorder[i]] = i;
+    }
+
+    // the first block dominates itself while iterating
+    immediate_dominator[0] = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b : reverse_postorder) {
+            if (b == 0) {
+                continue;
+            }
+            int dominator = -1;
+            for (int predecessor : blocks[b].predecessors) {
+                if (immediate_dominator[predecessor] < 0) {
+                    continue;
+                }
+                if (dominator < 0) {
+                    dominator = predecessor;
+                    continue;
+                }
+                // the nearest common dominator
+                int other = predecessor;
+                while (dominator != other) {
+                    while (order[dominator] > order[other]) {
+                        dominator = immediate_dominator[dominator];
+                    }
+                    while (order[other] > order[dominator]) {
+                        other = immediate_dominator[other];
+                    }
+                }
+            }
+            if (immediate_dominator[b] != dominator) {
+                immediate_dominator[b] = dominator;
+                changed = true;
+            }
+        }
+    }
+    immediate_dominator[0] = -1;
+    for (int b : reverse_postorder) {
+        if (b != 0) {
+            dominated[immediate_dominator[b]].push_back(b);
+        }
+    }
+}
+
+vector<int> ControlFlowGraph::next_instructions(int position) const {
+    const IRInst& inst = code[position];
+    int target = ir_jump_target(inst);
+    if (inst.op == IR_RETURN) {
+        return {};
+    }
+    if (inst.op == IR_JUMP) {
+        return {label_position[target]};
+    }
+    if (target >= 0) {
+        return {label_position[target], position + 1};
+    }
+    return {position + 1};
+}
+
+bool ControlFlowGraph::is_live(int slot, int position) const {
+    // search forward for a read of the variable before it is defined again
+    vector<bool> visited(code.size() + 1, false);
+    vector<int> pending = {position};
+    visited[position] = true;
+    while (!pending.empty()) {
+        int i = pending.back();
+        pending.pop_back();
+        if (i == (int)code.size()) {
+            continue;
+        }
+        if (ir_reads(code[i], ir_slot(slot))) {
+            return true;
+        }
+        if (ir_defines(code[i].op) && code[i].dst == ir_slot(slot)) {
+            continue;
+        }
+        for (int next : next_instructions(i)) {
+            if (!visited[next]) {
+                visited[next] = true;
+                pending.push_back(next);
+            }
+        }
+    }
+    return false;
+}
+
+bool ControlFlowGraph::constant_before(int slot, int position, int32_t* value) const {
+    // search backward for the definitions reaching the position, which must all move the same immediate
+    if (position == 0) {
+        return false;
+    }
+    bool found = false;
+    vector<bool> visited(blocks.size(), false);
+    // the block, and where to search back from; the first block is searched again from its end if reached by a loop
+    vector<pair<int, int>> pending = {{block_of[position - 1], position}};
+    while (!pending.empty()) {
+        int b = pending.back().first, i = pending.back().second;
+        pending.pop_back();
+        while (i > blocks[b].start && !(ir_defines(code[i - 1].op) && code[i - 1].dst == ir_slot(slot))) {
+            i--;
+        }
+        if (i > blocks[b].start) {
+            const IRInst& definition = code[i - 1];
+            if (definition.op != IR_MOV || definition.a.kind != OPD_IMM || (found && definition.a.value != *value)) {
+                return false;
+            }
+            found = true;
+            *value = definition.a.value;
+            continue;
+        }
+        if (blocks[b].predecessors.empty()) {
+            // the start of the program, or unreachable code
+            return false;
+        }
+        for (int predecessor : blocks[b].predecessors) {
+            if (!visited[predecessor]) {
+                visited[predecessor] = true;
+                pending.push_back({predecessor, blocks[predecessor].end});
+            }
+        }
+    }
+    return found;
+}
@@ -0,0 +1,56 @@
+/*
+    File: cfg.h
+    Author: Jiaqi Li
+    The control-flow graph of the IR program, shared by the optimizations over the IR and the MIPS emitter.
+
+    A basic block starts at a label or after a jump, a branch or a return, and ends before the next one.
+    The dominators are computed by the iterative algorithm of Cooper, Harvey and Kennedy over the reverse postorder.
+    Every loop of the language is closed by backward jumps or branches to its start label, and is only entered
+    there, so a loop is the range of instructions from its label to the last backward jump or branch to it.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "ir.h"
+
+struct BasicBlock {
+    int start;  // the first instruction
+    int end;    // one past the last instruction
+    std::vector<int> successors;
+    std::vector<int> predecessors;
+};
+
+struct IRLoop {
+    int start;  // the label starting the loop
+    int end;    // the last backward jump or branch to the label
+};
+
+class ControlFlowGraph {
+public:
+    explicit ControlFlowGraph(const std::vector<IRInst>& code);
+
+    std::vector<BasicBlock> blocks;
+    std::vector<int> block_of;          // the block of each instruction
+    std::vector<int> label_position;    // the instruction of each label, by its number
+    std::vector<IRLoop> loops;          // in the order of their start, so an outer loop comes before its inner loops
+    std::vector<int> reverse_postorder;     // the blocks reachable from the start of the program
+    std::vector<int> immediate_dominator;   // the immediate dominator of each block, -1 for the first and unreachable ones
+    std::vector<std::vector<int>> dominated;    // the blocks each block is the immediate dominator of
+
+    // whether the value of the variable at `slot` before instruction `position` may be read later
+    bool is_live(int slot, int position) const;
+
+    // whether the variable at `slot` holds the same constant on every path falling through instruction
+    // `position - 1` into instruction `position`, which is then stored in `value`
+    bool constant_before(int slot, int position, int32_t* value) const;
+
+private:
+    const std::vector<IRInst>& code;
+
+    // the instructions that may run right after instruction `position`, the end of the program is code.size()
+    std::vector<int> next_instructions(int position) const;
+
+    void compute_dominators();
+};
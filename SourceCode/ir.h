@@ -0,0 +1,220 @@
+/*
+    File: ir.h
+    Author: Jiaqi Li
+    The three-address intermediate representation (IR) between the semantic routines and the MIPS emitter.
+
+    Each `IRInst` is an opcode with a destination and up to two source operands.
+    An operand is an immediate, a variable's stack slot, a virtual register holding a temporary, or a label.
+    A virtual register is defined once, except the 0 or 1 of a logical expression, defined on both of its paths.
+    The logical operators && and || are lowered to branches by the semantic routines, they have no opcode.
+    The semantic routines lower the code into IR instructions, and the emitter prints them as MIPS instructions.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+enum ir_opcode : uint8_t {
+    // dst = a OP b
+    IR_ADD, IR_SUB, IR_MUL, IR_DIV,
+    IR_REM,         // the remainder of a / b, with the sign of a; C1 spells it a - b * (a / b)
+    IR_SHL, IR_SHR, IR_AND, IR_OR,
+    IR_EQ, IR_NE, IR_LT, IR_GT, IR_LE, IR_GE,
+
+    // dst = OP a
+    IR_NOT, IR_NEG,
+    IR_MOV,
+
+    IR_LOAD_ELEM,   // dst = (array at slot a)[b]
+    IR_STORE_ELEM,  // (array at slot dst)[a] = b
+    IR_ELEM_ADDR,   // dst = the address of element a of an array at $sp, i.e. $sp - 4 * a
+    IR_LOAD_PTR,    // dst = the element at slot a, shifted by the address b from IR_ELEM_ADDR
+    IR_STORE_PTR,   // the element at slot dst, shifted by the address a from IR_ELEM_ADDR, = b
+
+    IR_READ,        // dst = scanf()
+    IR_WRITE,       // printf(a)
+
+    IR_LABEL,       // a:
+    IR_JUMP,        // goto a
+    // if (a OP b) goto dst, in the same order as the comparisons
+    IR_BRANCH_EQ, IR_BRANCH_NE, IR_BRANCH_LT, IR_BRANCH_GT, IR_BRANCH_LE, IR_BRANCH_GE,
+    IR_RETURN,      // goto the end of the program
+};
+
+enum ir_operand_kind : uint8_t {
+    OPD_NONE,
+    OPD_IMM,    // an immediate
+    OPD_SLOT,   // a variable (or array) in the stack, by its offset from $sp
+    OPD_VREG,   // a virtual register, by its number
+    OPD_LABEL,  // a label, by its number
+};
+
+struct IROperand {
+    ir_operand_kind kind;
+    int32_t value;
+
+    bool operator==(const IROperand& other) const {
+        return kind == other.kind && value == other.value;
+    }
+    bool operator!=(const IROperand& other) const {
+        return !(*this == other);
+    }
+};
+
+inline IROperand ir_none() {
+    return IROperand{OPD_NONE, 0};
+}
+inline IROperand ir_imm(int32_t value) {
+    return IROperand{OPD_IMM, value};
+}
+inline IROperand ir_slot(int32_t offset) {
+    return IROperand{OPD_SLOT, offset};
+}
+inline IROperand ir_vreg(int32_t vreg) {
+    return IROperand{OPD_VREG, vreg};
+}
+inline IROperand ir_label(int32_t label) {
+    return IROperand{OPD_LABEL, label};
+}
+
+struct IRInst {
+    ir_opcode op;
+    IROperand dst;
+    IROperand a;
+    IROperand b;
+};
+
+// evaluate an operator on constants as the emitted MIPS code does, with 32-bit wraparound
+// unary operators ignore `b`; returns false if it cannot be evaluated at compile time
+inline bool ir_evaluate(ir_opcode op, int32_t a, int32_t b, int32_t* result) {
+    uint32_t ua = a, ub = b;
+    switch (op)
+    {
+    case IR_ADD: *result = (int32_t)(ua + ub); break;
+    case IR_SUB: *result = (int32_t)(ua - ub); break;
+    case IR_MUL: *result = (int32_t)(ua * ub); break;
+    case IR_DIV:
+        // division by zero, and the overflowing INT_MIN / -1, are left to the run time
+        if (b == 0 || (a == INT32_MIN && b == -1)) {
+            return false;
+        }
+        *result = a / b;
+        break;
+    case IR_REM:
+        if (b == 0 || (a == INT32_MIN && b == -1)) {
+            return false;
+        }
+        *result = a % b;
+        break;
+    case IR_SHL: *result = (int32_t)(ua << (ub & 31)); break;
+    case IR_SHR: *result = (int32_t)(ua >> (ub & 31)); break;     // logical shift
+    case IR_AND: *result = a & b; break;
+    case IR_OR: *result = a | b; break;
+    case IR_EQ: *result = a == b; break;
+    case IR_NE: *result = a != b; break;
+    case IR_LT: *result = a < b; break;
+    case IR_GT: *result = a > b; break;
+    case IR_LE: *result = a <= b; break;
+    case IR_GE: *result = a >= b; break;
+    case IR_NOT: *result = !a; break;
+    case IR_NEG: *result = (int32_t)(0u - ua); break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+inline bool ir_is_commutative(ir_opcode op) {
+    return op == IR_ADD || op == IR_MUL || op == IR_AND || op == IR_OR || op == IR_EQ || op == IR_NE;
+}
+
+inline bool ir_is_comparison(ir_opcode op) {
+    return op >= IR_EQ && op <= IR_GE;
+}
+
+inline bool ir_is_branch(ir_opcode op) {
+    return op >= IR_BRANCH_EQ && op <= IR_BRANCH_GE;
+}
+
+// the branch taken if the comparison is true, and the comparison a branch tests
+inline ir_opcode ir_branch_of(ir_opcode comparison) {
+    return (ir_opcode)(IR_BRANCH_EQ + (comparison - IR_EQ));
+}
+inline ir_opcode ir_comparison_of(ir_opcode branch) {
+    return (ir_opcode)(IR_EQ + (branch - IR_BRANCH_EQ));
+}
+
+// the comparison true exactly when the given one is false, e.g. >= for <
+inline ir_opcode ir_negate_comparison(ir_opcode comparison) {
+    switch (comparison)
+    {
+    case IR_EQ: return IR_NE;
+    case IR_NE: return IR_EQ;
+    case IR_LT: return IR_GE;
+    case IR_GE: return IR_LT;
+    case IR_GT: return IR_LE;
+    default: return IR_GT;     // IR_LE
+    }
+}
+
+// the comparison of the swapped operands, e.g. > for <
+inline ir_opcode ir_swap_comparison(ir_opcode comparison) {
+    switch (comparison)
+    {
+    case IR_LT: return IR_GT;
+    case IR_GT: return IR_LT;
+    case IR_LE: return IR_GE;
+    case IR_GE: return IR_LE;
+    default: return comparison;     // IR_EQ, IR_NE
+    }
+}
+
+// whether the instruction defines its `dst` operand, rather than storing to an array or jumping
+inline bool ir_defines(ir_opcode op) {
+    return op != IR_STORE_ELEM && op != IR_STORE_PTR && op != IR_WRITE && op < IR_LABEL;
+}
+
+// whether the operand is the array accessed by the instruction
+inline bool ir_is_array_operand(const IRInst& inst, const IROperand* opd) {
+    return ((inst.op == IR_LOAD_ELEM || inst.op == IR_LOAD_PTR) && opd == &inst.a)
+        || ((inst.op == IR_STORE_ELEM || inst.op == IR_STORE_PTR) && opd == &inst.dst);
+}
+
+// whether the instruction reads the value of a variable or a virtual register
+inline bool ir_reads(const IRInst& inst, IROperand opd) {
+    return (inst.a == opd && !ir_is_array_operand(inst, &inst.a)) || inst.b == opd;
+}
+
+// the label a jump or a branch goes to, or -1
+inline int ir_jump_target(const IRInst& inst) {
+    if (inst.op == IR_JUMP) {
+        return inst.a.value;
+    }
+    return ir_is_branch(inst.op) ? inst.dst.value : -1;
+}
+
+// the IR of a whole program, in contiguous arrays
+struct IRProgram {
+    std::vector<IRInst> code;
+    std::vector<int> vreg_home;     // the stack slot (offset from $sp) each virtual register is kept in
+    std::vector<std::pair<int, int>> arrays;   // the slot of the first element and the length of every array
+    int frame_size = 0;     // the bytes of stack taken by the slots above
+
+    // a new slot for a variable introduced by an optimization
+    int new_slot() {
+        frame_size += 4;
+        return -frame_size;
+    }
+
+    // the array the slot is an element of, or nullptr for a scalar variable
+    const std::pair<int, int>* array_of(int slot) const {
+        for (const std::pair<int, int>& array : arrays) {
+            if (slot <= array.first && slot > array.first - 4 * array.second) {
+                return &array;
+            }
+        }
+        return nullptr;
+    }
+};
@@ -0,0 +1,586 @@
+/*
+    File: loop_optimizer.cpp
+    Author: Jiaqi Li
+    The loop optimizations over the IR program
+
+    A basic induction variable of a loop is a scalar variable only defined in the loop by `i = i + c` or `i = i - c`.
+    The pointer p = $sp - 4 * i is set before the loop and stepped by -4 * c right after each update of i,
+    so element i + k of an array stays at a fixed offset from p, and the accesses need no address computation.
+
+    The loop test `i < n` of a while loop becomes `p > $sp - 4 * n`, and the updates of i are removed, when i
+    starts from a constant, n is a constant, i is only used by the accesses, its updates and the test, and i is
+    dead after the loop. The values tested must stay within [-256, 2^20], where the pointers do not overflow,
+    as the stack is right below 2^31.
+
+    A loop-invariant computation reads only constants, variables not defined in the loop, elements of arrays not
+    stored to in the loop, and other invariants. It is hoisted into a preheader right before the loop label,
+    still into its virtual register, which is defined only there. A load or a division by a variable may fault,
+    so it is only hoisted if it runs in every iteration, that is, it dominates every exit of the loop.
+    An access at an invariant index that is not hoisted goes through an element address set in the preheader.
+    The inner loops are done first, so an invariant of several loops moves out of all of them.
+*/
+
+#include <map>
+#include <set>
+#include <algorithm>
+
+#include "loop_optimizer.h"
+#include "cfg.h"
+
+using namespace std;
+
+class InductionVariableReducer {
+public:
+    explicit InductionVariableReducer(IRProgram* program) : program(*program) {}
+
+    void reduce(ostream* stats) {
+        // the loops are reduced outer first against the code as it is, and the instructions inserted and removed
+        // are applied at the end, so one control-flow graph serves every loop
+        vector<IRInst>& code = program.code;
+        ControlFlowGraph cfg(code);
+        count_vregs();
+        first_jump.assign(cfg.label_position.size(), code.size());
+        for (int i = 0; i < (int)code.size(); i++) {
+            int target = ir_jump_target(code[i]);
+            if (target >= 0 && first_jump[target] > i) {
+                first_jump[target] = i;
+            }
+        }
+        inserted.assign(code.size() + 1, {});
+        removed.assign(code.size(), false);
+        for (const IRLoop& loop : cfg.loops) {
+            reduce_loop(cfg, loop);
+        }
+
+        vector<IRInst> reduced;
+        for (int i = 0; i <= (int)code.size(); i++) {
+            reduced.insert(reduced.end(), inserted[i].begin(), inserted[i].end());
+            if (i < (int)code.size() && !removed[i]) {
+                reduced.push_back(code[i]);
+            }
+        }
+        code.swap(reduced);
+        if (stats) {
+            *stats << "induction variables: " << reduced_accesses << " array accesses through " << pointers
+                   << " pointers, " << replaced_tests << " loop tests replaced\n";
+        }
+    }
+
+private:
+    // the range of the indices tested through a pointer
+    static const int32_t min_index = -256;
+    static const int32_t max_index = 1 << 20;
+
+    struct Update {
+        int add;        // i + c into a virtual register
+        int mov;        // the virtual register back into i
+        int32_t step;   // c
+    };
+
+    struct Access {
+        int position;
+        int index_definition;   // the i + k into the index, or -1 if the index is i itself
+        int32_t offset;         // k
+    };
+
+    IRProgram& program;
+    int reduced_accesses = 0;
+    int pointers = 0;
+    int replaced_tests = 0;
+
+    vector<int> vreg_definition;    // the instruction defining each virtual register, -2 if defined more than once
+    vector<int> vreg_uses;          // the number of instructions reading each virtual register
+    vector<int> first_jump;         // the first jump or branch to each label, code.size() if none
+    vector<vector<IRInst>> inserted;    // the instructions to insert before each instruction
+    vector<bool> removed;
+
+    void count_vregs() {
+        vreg_definition.assign(program.vreg_home.size(), -1);
+        vreg_uses.assign(program.vreg_home.size(), 0);
+        for (int i = 0; i < (int)program.code.size(); i++) {
+            const IRInst& inst = program.code[i];
+            if (ir_defines(inst.op) && inst.dst.kind == OPD_VREG) {
+                int& definition = vreg_definition[inst.dst.value];
+                definition = definition == -1 ? i : -2;
+            }
+            for (const IROperand& opd : {inst.a, inst.b}) {
+                if (opd.kind == OPD_VREG) {
+                    vreg_uses[opd.value]++;
+                }
+            }
+        }
+    }
+
+    // whether the instruction computes `slot + offset` for a constant offset
+    static bool is_offset(const IRInst& inst, int slot, int32_t* offset) {
+        if (inst.op == IR_ADD && inst.a == ir_slot(slot) && inst.b.kind == OPD_IMM) {
+            *offset = inst.b.value;
+        } else if (inst.op == IR_ADD && inst.b == ir_slot(slot) && inst.a.kind == OPD_IMM) {
+            *offset = inst.a.value;
+        } else if (inst.op == IR_SUB && inst.a == ir_slot(slot) && inst.b.kind == OPD_IMM && inst.b.value != INT32_MIN) {
+            *offset = -inst.b.value;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    // the instruction defining the virtual register read once at `position`, if it is within [start, position)
+    int single_use_definition(IROperand opd, int start, int position) const {
+        if (opd.kind != OPD_VREG || vreg_uses[opd.value] != 1) {
+            return -1;
+        }
+        int definition = vreg_definition[opd.value];
+        return definition >= start && definition < position ? definition : -1;
+    }
+
+    // the instruction is removed, and no longer defines or reads its virtual registers
+    void remove(int position) {
+        const IRInst& inst = program.code[position];
+        removed[position] = true;
+        if (ir_defines(inst.op) && inst.dst.kind == OPD_VREG) {
+            vreg_definition[inst.dst.value] = -1;
+        }
+        for (const IROperand& opd : {inst.a, inst.b}) {
+            if (opd.kind == OPD_VREG) {
+                vreg_uses[opd.value]--;
+            }
+        }
+    }
+
+    bool defined_between(int slot, int from, int to) const {
+        for (int i = from + 1; i < to; i++) {
+            if (ir_defines(program.code[i].op) && program.code[i].dst == ir_slot(slot)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void reduce_loop(const ControlFlowGraph& cfg, const IRLoop& loop) {
+        vector<IRInst>& code = program.code;
+        int start = loop.start, end = loop.end;
+        // the code before the loop goes through its label, so the pointers can be set right before it
+        if (first_jump[code[start].a.value] < start) {
+            return;
+        }
+
+        // the basic induction variables, and their updates
+        map<int, vector<Update>> updates;
+        vector<int> not_induction;
+        for (int i = start; i <= end; i++) {
+            const IRInst& inst = code[i];
+            if (!ir_defines(inst.op) || inst.dst.kind != OPD_SLOT) {
+                continue;
+            }
+            int slot = inst.dst.value;
+            if (program.array_of(slot)) {
+                // an element accessed at a constant index may also be stored through a variable index
+                not_induction.push_back(slot);
+                continue;
+            }
+            int definition = inst.op == IR_MOV ? single_use_definition(inst.a, start, i) : -1;
+            int32_t step;
+            if (definition >= 0 && is_offset(code[definition], slot, &step) && !defined_between(slot, definition, i)
+                && step != 0 && step > -max_index && step < max_index) {
+                updates[slot].push_back(Update{definition, i, step});
+            } else {
+                not_induction.push_back(slot);
+            }
+        }
+        for (int slot : not_induction) {
+            updates.erase(slot);
+        }
+
+        // the array accesses at i + k, within the array
+        map<int, vector<Access>> accesses;
+        for (int i = start; i <= end; i++) {
+            const IRInst& inst = code[i];
+            IROperand array, index;
+            if (inst.op == IR_LOAD_ELEM) {
+                array = inst.a;
+                index = inst.b;
+            } else if (inst.op == IR_STORE_ELEM) {
+                array = inst.dst;
+                index = inst.a;
+            } else {
+                continue;
+            }
+            int length = program.array_of(array.value)->second;
+            if (index.kind == OPD_SLOT && updates.count(index.value)) {
+                accesses[index.value].push_back(Access{i, -1, 0});
+                continue;
+            }
+            int definition = single_use_definition(index, start, i);
+            if (definition < 0) {
+                continue;
+            }
+            for (const IROperand& opd : {code[definition].a, code[definition].b}) {
+                int32_t offset;
+                if (opd.kind == OPD_SLOT && updates.count(opd.value) && is_offset(code[definition], opd.value, &offset)
+                    && offset >= 0 && offset < length && !defined_between(opd.value, definition, i)) {
+                    accesses[opd.value].push_back(Access{i, definition, offset});
+                    break;
+                }
+            }
+        }
+
+        for (const pair<const int, vector<Access>>& variable : accesses) {
+            int slot = variable.first;
+            int pointer = program.new_slot();
+            pointers++;
+
+            IROperand initial = ir_slot(slot);
+            if (replace_test(cfg, loop, slot, updates[slot], variable.second, pointer, &initial)) {
+                replaced_tests++;
+            }
+            inserted[start].push_back(IRInst{IR_ELEM_ADDR, ir_slot(pointer), initial, ir_none()});
+            for (const Update& update : updates[slot]) {
+                inserted[update.mov + 1].push_back(IRInst{IR_ADD, ir_slot(pointer), ir_slot(pointer), ir_imm(-4 * update.step)});
+            }
+            for (const Access& access : variable.second) {
+                IRInst& inst = code[access.position];
+                if (access.index_definition >= 0) {
+                    vreg_uses[(inst.op == IR_LOAD_ELEM ? inst.b : inst.a).value]--;
+                    remove(access.index_definition);
+                }
+                if (inst.op == IR_LOAD_ELEM) {
+                    inst = IRInst{IR_LOAD_PTR, inst.dst, ir_slot(inst.a.value - 4 * access.offset), ir_slot(pointer)};
+                } else {
+                    inst = IRInst{IR_STORE_PTR, ir_slot(inst.dst.value - 4 * access.offset), ir_slot(pointer), inst.b};
+                }
+                reduced_accesses++;
+            }
+        }
+    }
+
+    // replace i by the pointer in the test at the start of a while loop, see the file comment
+    // the pointer then starts from the constant `initial`
+    bool replace_test(const ControlFlowGraph& cfg, const IRLoop& loop, int slot, const vector<Update>& slot_updates,
+                      const vector<Access>& slot_accesses, int pointer, IROperand* initial) {
+        const vector<IRInst>& code = program.code;
+        int start = loop.start, end = loop.end;
+        if (start + 1 > end || end + 1 >= (int)code.size() || code[end + 1].op != IR_LABEL) {
+            return false;
+        }
+        // the test leaves the loop if `i op bound`
+        const IRInst& test = code[start + 1];
+        if (!ir_is_branch(test.op) || test.dst != code[end + 1].a) {
+            return false;
+        }
+        ir_opcode op = ir_comparison_of(test.op);
+        IROperand bound = test.b;
+        if (test.b == ir_slot(slot)) {
+            op = ir_swap_comparison(op);
+            bound = test.a;
+        } else if (test.a != ir_slot(slot)) {
+            return false;
+        }
+        if (bound.kind != OPD_IMM) {
+            return false;
+        }
+
+        // the updates step towards the bound, by a few constants in each iteration
+        long long per_iteration = 0;
+        bool increasing = slot_updates[0].step > 0;
+        for (const Update& update : slot_updates) {
+            if ((update.step > 0) != increasing) {
+                return false;
+            }
+            for (const IRLoop& inner : cfg.loops) {
+                if (inner.start > start && inner.start <= end && update.mov >= inner.start && update.mov <= inner.end) {
+                    return false;
+                }
+            }
+            per_iteration += abs((long long)update.step);
+        }
+        if (increasing ? op != IR_GE && op != IR_GT : op != IR_LE && op != IR_LT) {
+            return false;
+        }
+
+        // i is only read by the test, its updates and the accesses, and is dead after the loop
+        vector<int> allowed = {start + 1};
+        for (const Update& update : slot_updates) {
+            allowed.push_back(update.add);
+        }
+        for (const Access& access : slot_accesses) {
+            if (access.index_definition < 0 && code[access.position].op == IR_STORE_ELEM && code[access.position].b == ir_slot(slot)) {
+                // i is also the value stored
+                return false;
+            }
+            allowed.push_back(access.index_definition >= 0 ? access.index_definition : access.position);
+        }
+        for (int i = start; i <= end; i++) {
+            if (ir_reads(code[i], ir_slot(slot)) && find(allowed.begin(), allowed.end(), i) == allowed.end()) {
+                return false;
+            }
+        }
+        int32_t first;
+        if (cfg.is_live(slot, end + 1) || !cfg.constant_before(slot, start, &first)) {
+            return false;
+        }
+        // the values tested go from the first one up (or down) to at most a step past the bound
+        long long lowest = increasing ? first : min((long long)first, bound.value - per_iteration);
+        long long highest = increasing ? max((long long)first, bound.value + per_iteration) : first;
+        if (lowest < min_index || highest > max_index) {
+            return false;
+        }
+
+        // p = $sp - 4 * i decreases as i increases
+        int limit = program.new_slot();
+        inserted[start].push_back(IRInst{IR_ELEM_ADDR, ir_slot(limit), bound, ir_none()});
+        program.code[start + 1] = IRInst{ir_branch_of(ir_swap_comparison(op)), test.dst, ir_slot(pointer), ir_slot(limit)};
+        for (const Update& update : slot_updates) {
+            remove(update.add);
+            remove(update.mov);
+        }
+        *initial = ir_imm(first);
+        return true;
+    }
+};
+
+class InvariantMover {
+public:
+    explicit InvariantMover(IRProgram* program) : program(*program) {}
+
+    void hoist(ostream* stats) {
+        // the inner loops first, against the code as it is: each preheader is kept apart, before the label of its
+        // loop, where the loops around it may still hoist from it, and is inserted at the end, so one control-flow
+        // graph serves every loop
+        vector<IRInst>& code = program.code;
+        ControlFlowGraph cfg(code);
+        vreg_definitions.assign(program.vreg_home.size(), 0);
+        first_jump.assign(cfg.label_position.size(), code.size());
+        last_jump.assign(cfg.label_position.size(), -1);
+        next_label = cfg.label_position.size();
+        for (int i = 0; i < (int)code.size(); i++) {
+            const IRInst& inst = code[i];
+            if (ir_defines(inst.op) && inst.dst.kind == OPD_VREG) {
+                vreg_definitions[inst.dst.value]++;
+            }
+            int target = ir_jump_target(inst);
+            if (target >= 0) {
+                first_jump[target] = min(first_jump[target], i);
+                last_jump[target] = i;
+            }
+        }
+        preheader_of.assign(code.size(), {});
+        removed.assign(code.size(), false);
+        for (int i = cfg.loops.size() - 1; i >= 0; i--) {
+            hoist_loop(cfg, cfg.loops[i]);
+        }
+
+        vector<IRInst> moved;
+        for (int i = 0; i < (int)code.size(); i++) {
+            moved.insert(moved.end(), preheader_of[i].begin(), preheader_of[i].end());
+            if (!removed[i]) {
+                moved.push_back(code[i]);
+            }
+        }
+        code.swap(moved);
+        if (stats) {
+            *stats << "loop invariants: " << hoisted << " instructions and " << addresses
+                   << " element addresses hoisted into " << preheaders << " preheaders\n";
+        }
+    }
+
+private:
+    // an instruction of a loop: code[position], or instruction `index` of the preheader before it
+    struct Member {
+        int position;
+        int index;
+    };
+
+    IRProgram& program;
+    int hoisted = 0;
+    int addresses = 0;
+    int preheaders = 0;
+
+    vector<int> vreg_definitions;   // the number of instructions defining each virtual register
+    vector<int> first_jump;         // the first jump or branch to each label, code.size() if none
+    vector<int> last_jump;          // the last jump or branch to each label, -1 if none
+    int next_label = 0;
+    vector<vector<IRInst>> preheader_of;    // the preheader to insert before each loop label
+    vector<bool> removed;                   // the instructions moved into a preheader
+
+    set<int> defined_slots;     // the variables defined in the loop
+    set<int> defined_vregs;     // the virtual registers defined in the loop
+    set<int> stored_arrays;     // the first slot of the arrays stored to in the loop
+
+    IRInst& instruction(Member member) {
+        return member.index < 0 ? program.code[member.position] : preheader_of[member.position][member.index];
+    }
+
+    bool is_invariant(IROperand opd) const {
+        if (opd.kind == OPD_IMM) {
+            return true;
+        }
+        if (opd.kind == OPD_VREG) {
+            return defined_vregs.count(opd.value) == 0;
+        }
+        if (opd.kind == OPD_SLOT) {
+            const pair<int, int>* array = program.array_of(opd.value);
+            return defined_slots.count(opd.value) == 0 && (array == nullptr || stored_arrays.count(array->first) == 0);
+        }
+        return false;
+    }
+
+    // whether block `dominator` runs before block `b` on every path to it
+    static bool dominates(const ControlFlowGraph& cfg, int dominator, int b) {
+        for (; b >= 0; b = cfg.immediate_dominator[b]) {
+            if (b == dominator) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void hoist_loop(const ControlFlowGraph& cfg, const IRLoop& loop) {
+        vector<IRInst>& code = program.code;
+        int start = loop.start, end = loop.end;
+
+        // the instructions of the loop, with the preheaders of its inner loops before their labels
+        vector<Member> body;
+        for (int i = start + 1; i <= end; i++) {
+            for (int k = 0; k < (int)preheader_of[i].size(); k++) {
+                body.push_back(Member{i, k});
+            }
+            if (!removed[i]) {
+                body.push_back(Member{i, -1});
+            }
+        }
+
+        // what the loop defines and stores to, and the blocks leaving it
+        defined_slots.clear();
+        defined_vregs.clear();
+        stored_arrays.clear();
+        for (Member member : body) {
+            const IRInst& inst = instruction(member);
+            if (inst.op == IR_STORE_ELEM || inst.op == IR_STORE_PTR) {
+                stored_arrays.insert(program.array_of(inst.dst.value)->first);
+            } else if (ir_defines(inst.op) && inst.dst.kind == OPD_VREG) {
+                defined_vregs.insert(inst.dst.value);
+            } else if (ir_defines(inst.op) && inst.dst.kind == OPD_SLOT) {
+                defined_slots.insert(inst.dst.value);
+                const pair<int, int>* array = program.array_of(inst.dst.value);
+                if (array) {
+                    stored_arrays.insert(array->first);
+                }
+            }
+        }
+        vector<int> exits;
+        for (int b = cfg.block_of[start]; b <= cfg.block_of[end]; b++) {
+            bool leaves = code[cfg.blocks[b].end - 1].op == IR_RETURN;
+            for (int successor : cfg.blocks[b].successors) {
+                leaves = leaves || successor < cfg.block_of[start] || successor > cfg.block_of[end];
+            }
+            if (leaves) {
+                exits.push_back(b);
+            }
+        }
+
+        // the invariants, until no more are found as their operands become invariant
+        // a preheader runs whenever the label after it is reached from outside its loop, so it has the dominance
+        // of that label
+        vector<IRInst> preheader;
+        vector<bool> taken(body.size(), false);
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (int k = 0; k < (int)body.size(); k++) {
+                const IRInst& inst = instruction(body[k]);
+                bool is_load = inst.op == IR_LOAD_ELEM || inst.op == IR_LOAD_PTR;
+                if (taken[k] || inst.dst.kind != OPD_VREG || vreg_definitions[inst.dst.value] != 1
+                    || !(inst.op < IR_MOV || inst.op == IR_ELEM_ADDR || is_load)) {
+                    continue;
+                }
+                bool unary = inst.op == IR_NOT || inst.op == IR_NEG || inst.op == IR_ELEM_ADDR;
+                if (is_load ? !is_invariant(inst.b) || stored_arrays.count(program.array_of(inst.a.value)->first)
+                            : !is_invariant(inst.a) || (!unary && !is_invariant(inst.b))) {
+                    continue;
+                }
+                bool may_fault = is_load || ((inst.op == IR_DIV || inst.op == IR_REM) && (inst.b.kind != OPD_IMM || inst.b.value == 0));
+                bool runs_always = true;
+                for (int b : exits) {
+                    runs_always = runs_always && dominates(cfg, cfg.block_of[body[k].position], b);
+                }
+                if (may_fault && !runs_always) {
+                    continue;
+                }
+                preheader.push_back(inst);
+                defined_vregs.erase(inst.dst.value);
+                taken[k] = true;
+                hoisted++;
+                changed = true;
+            }
+        }
+
+        // the element addresses at the invariant indices left
+        map<pair<int, int>, int> pointer_of;    // the pointer to each element index, by the kind and value of the index
+        for (int k = 0; k < (int)body.size(); k++) {
+            IRInst& inst = instruction(body[k]);
+            if (taken[k] || (inst.op != IR_LOAD_ELEM && inst.op != IR_STORE_ELEM)) {
+                continue;
+            }
+            IROperand index = inst.op == IR_LOAD_ELEM ? inst.b : inst.a;
+            if (index.kind == OPD_IMM || !is_invariant(index)) {
+                continue;
+            }
+            pair<int, int> key(index.kind, index.value);
+            if (pointer_of.count(key) == 0) {
+                pointer_of[key] = program.new_slot();
+                preheader.push_back(IRInst{IR_ELEM_ADDR, ir_slot(pointer_of[key]), index, ir_none()});
+            }
+            IROperand pointer = ir_slot(pointer_of[key]);
+            if (inst.op == IR_LOAD_ELEM) {
+                inst = IRInst{IR_LOAD_PTR, inst.dst, inst.a, pointer};
+            } else {
+                inst = IRInst{IR_STORE_PTR, inst.dst, pointer, inst.b};
+            }
+            addresses++;
+        }
+        if (preheader.empty()) {
+            return;
+        }
+        preheaders++;
+
+        // backward, so the indices into the preheaders of the inner loops stay valid
+        for (int k = body.size() - 1; k >= 0; k--) {
+            if (!taken[k]) {
+                continue;
+            }
+            if (body[k].index < 0) {
+                removed[body[k].position] = true;
+            } else {
+                vector<IRInst>& inner = preheader_of[body[k].position];
+                inner.erase(inner.begin() + body[k].index);
+            }
+        }
+
+        // the jumps from before the loop still go through the preheader, and the loop starts at a new label
+        int header_label = code[start].a.value;
+        if (first_jump[header_label] < start || last_jump[header_label] > end) {
+            int label = next_label++;
+            for (int i = start; i <= end; i++) {
+                if (code[i].op == IR_JUMP && code[i].a.value == header_label) {
+                    code[i].a = ir_label(label);
+                } else if (ir_is_branch(code[i].op) && code[i].dst.value == header_label) {
+                    code[i].dst = ir_label(label);
+                }
+            }
+            preheader.insert(preheader.begin(), IRInst{IR_LABEL, ir_none(), ir_label(header_label), ir_none()});
+            code[start].a = ir_label(label);
+        }
+        preheader_of[start].swap(preheader);
+    }
+};
+
+void reduce_induction_variables(IRProgram* program, ostream* stats) {
+    InductionVariableReducer reducer(program);
+    reducer.reduce(stats);
+}
+
+void hoist_loop_invariants(IRProgram* program, ostream* stats) {
+    InvariantMover mover(program);
+    mover.hoist(stats);
+}
@@ -0,0 +1,21 @@
+/*
+    File: loop_optimizer.h
+    Author: Jiaqi Li
+    The loop optimizations over the IR program, run between the semantic routines and the MIPS emitter.
+*/
+
+#pragma once
+
+#include <iostream>
+
+#include "ir.h"
+
+// access the arrays indexed by a basic induction variable through a pointer stepping along with it,
+// and replace the variable by the pointer in the loop test where it is safe
+// the number of accesses and tests changed is printed to `stats` if given
+void reduce_induction_variables(IRProgram* program, std::ostream* stats = nullptr);
+
+// move the computations and loads that do not change in a loop into a preheader before it,
+// and compute the address of the elements at invariant indices there
+// the number of instructions and addresses hoisted is printed to `stats` if given
+void hoist_loop_invariants(IRProgram* program, std::ostream* stats = nullptr);
@@ -0,0 +1,202 @@
+/*
+    File: memory_optimizer.cpp
+    Author: Jiaqi Li
+    The optimizations of the arrays in memory
+
+    The scalar variables, and the arrays only accessed at constant indices, are left to the global optimizations,
+    whose dead code elimination already drops their unread stores, such as the zero a declaration starts with.
+    The elements of an array indexed by a variable (or a pointer) are memory instead, stored to and read by any index.
+
+    Dead store elimination computes the memory that may be read later, backward over the control-flow graph:
+    the arrays read at a variable index, and the elements read at a constant index. A store at a constant index
+    overwrites its element, and one at a variable index overwrites nothing. A store is dead if none of the
+    elements it may write is read later, and nothing is read after the end of the program. An array left without
+    any access then gets no slot from the emitter.
+*/
+
+#include <set>
+#include <vector>
+
+#include "memory_optimizer.h"
+#include "cfg.h"
+
+using namespace std;
+
+namespace {
+
+// the memory that may be read later
+struct LiveMemory {
+    vector<bool> arrays;    // whether any element of each array may be read, in the order of program.arrays
+    set<int> elements;      // the slots of the elements read at constant indices
+
+    bool operator==(const LiveMemory& other) const {
+        return arrays == other.arrays && elements == other.elements;
+    }
+    bool operator!=(const LiveMemory& other) const {
+        return !(*this == other);
+    }
+
+    void merge(const LiveMemory& other) {
+        for (int a = 0; a < (int)arrays.size(); a++) {
+            arrays[a] = arrays[a] || other.arrays[a];
+        }
+        elements.insert(other.elements.begin(), other.elements.end());
+    }
+};
+
+class DeadStoreElimination {
+public:
+    DeadStoreElimination(IRProgram* program) : program(*program), code(program->code), cfg(program->code) {}
+
+    int removed = 0;
+    int unaccessed_arrays = 0;  // the arrays in memory left without any access
+
+    void run() {
+        find_memory_arrays();
+        int blocks = cfg.blocks.size();
+        LiveMemory none{vector<bool>(program.arrays.size(), false), {}};
+        live_in.assign(blocks, none);
+
+        // solve the memory live at the start of each block
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (int b = blocks - 1; b >= 0; b--) {
+                LiveMemory live = live_out(b);
+                for (int i = cfg.blocks[b].end - 1; i >= cfg.blocks[b].start; i--) {
+                    transfer(code[i], &live);
+                }
+                if (live != live_in[b]) {
+                    live_in[b] = live;
+                    changed = true;
+                }
+            }
+        }
+
+        // remove the dead stores backward in each block
+        vector<bool> dead(code.size(), false);
+        for (int b = 0; b < blocks; b++) {
+            LiveMemory live = live_out(b);
+            for (int i = cfg.blocks[b].end - 1; i >= cfg.blocks[b].start; i--) {
+                if (is_dead_store(code[i], live)) {
+                    dead[i] = true;
+                    removed++;
+                    continue;
+                }
+                transfer(code[i], &live);
+            }
+        }
+        vector<IRInst> kept;
+        for (int i = 0; i < (int)code.size(); i++) {
+            if (!dead[i]) {
+                kept.push_back(code[i]);
+            }
+        }
+        code.swap(kept);
+
+        if (removed > 0) {
+            count_unaccessed_arrays();
+        }
+    }
+
+private:
+    IRProgram& program;
+    vector<IRInst>& code;
+    ControlFlowGraph cfg;
+    vector<bool> memory_array;  // whether each array is in memory, in the order of program.arrays
+    vector<LiveMemory> live_in;
+
+    // the arrays indexed by a variable or a pointer
+    void find_memory_arrays() {
+        memory_array.assign(program.arrays.size(), false);
+        for (const IRInst& inst : code) {
+            for (const IROperand* opd : {&inst.dst, &inst.a}) {
+                if (ir_is_array_operand(inst, opd)) {
+                    memory_array[array_index(opd->value)] = true;
+                }
+            }
+        }
+    }
+
+    // the index in program.arrays of the array the slot is an element of, or -1 for a scalar variable
+    int array_index(int slot) const {
+        const pair<int, int>* array = program.array_of(slot);
+        return array == nullptr ? -1 : array - &program.arrays[0];
+    }
+
+    // the array in memory an operand is an element of, or -1
+    int memory_element(const IRInst& inst, const IROperand* opd) const {
+        if (opd->kind != OPD_SLOT || ir_is_array_operand(inst, opd)) {
+            return -1;
+        }
+        int array = array_index(opd->value);
+        return array >= 0 && memory_array[array] ? array : -1;
+    }
+
+    LiveMemory live_out(int block) const {
+        LiveMemory live{vector<bool>(program.arrays.size(), false), {}};
+        for (int successor : cfg.blocks[block].successors) {
+            live.merge(live_in[successor]);
+        }
+        return live;
+    }
+
+    // the memory live before an instruction, from that live after it
+    void transfer(const IRInst& inst, LiveMemory* live) const {
+        if (memory_element(inst, &inst.dst) >= 0) {
+            live->elements.erase(inst.dst.value);
+        }
+        if (inst.op == IR_LOAD_ELEM || inst.op == IR_LOAD_PTR) {
+            live->arrays[array_index(inst.a.value)] = true;
+        }
+        for (const IROperand* opd : {&inst.a, &inst.b}) {
+            if (memory_element(inst, opd) >= 0) {
+                live->elements.insert(opd->value);
+            }
+        }
+    }
+
+    // whether the instruction only stores to memory not read later
+    bool is_dead_store(const IRInst& inst, const LiveMemory& live) const {
+        if (inst.op == IR_STORE_ELEM || inst.op == IR_STORE_PTR) {
+            int array = array_index(inst.dst.value);
+            if (live.arrays[array]) {
+                return false;
+            }
+            // any element of the array may be written
+            const pair<int, int>& extent = program.arrays[array];
+            set<int>::const_iterator it = live.elements.lower_bound(extent.first - 4 * (extent.second - 1));
+            return it == live.elements.end() || *it > extent.first;
+        }
+        int array = memory_element(inst, &inst.dst);
+        // a scanf still consumes its input
+        return array >= 0 && inst.op != IR_READ && !live.arrays[array] && live.elements.count(inst.dst.value) == 0;
+    }
+
+    void count_unaccessed_arrays() {
+        vector<bool> accessed(program.arrays.size(), false);
+        for (const IRInst& inst : code) {
+            for (const IROperand* opd : {&inst.dst, &inst.a, &inst.b}) {
+                if (opd->kind == OPD_SLOT && array_index(opd->value) >= 0) {
+                    accessed[array_index(opd->value)] = true;
+                }
+            }
+        }
+        for (int a = 0; a < (int)program.arrays.size(); a++) {
+            if (memory_array[a] && !accessed[a]) {
+                unaccessed_arrays++;
+            }
+        }
+    }
+};
+
+}
+
+void eliminate_dead_stores(IRProgram* program, ostream* stats) {
+    DeadStoreElimination elimination(program);
+    elimination.run();
+    if (stats) {
+        *stats << "memory: " << elimination.removed << " dead stores removed, "
+               << elimination.unaccessed_arrays << " arrays left without any access\n";
+    }
+}
@@ -0,0 +1,15 @@
+/*
+    File: memory_optimizer.h
+    Author: Jiaqi Li
+    The optimizations of the arrays in memory, run between the global optimizations and the MIPS emitter.
+*/
+
+#pragma once
+
+#include <iostream>
+
+#include "ir.h"
+
+// remove the stores to the arrays in memory whose values are never read on any path after them
+// the number of stores removed, and of arrays left without any access, is printed to `stats` if given
+void eliminate_dead_stores(IRProgram* program, std::ostream* stats = nullptr);
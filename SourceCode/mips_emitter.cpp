@@ -0,0 +1,891 @@
+/*
+    File: mips_emitter.cpp
+    Author: Jiaqi Li
+    The MIPS emitter for the Simplified C compiler
+
+    Each IR instruction is printed as a short sequence of MIPS instructions.
+    The arithmetic wraps around on overflow (addu, subu), the same as the constants folded at compile time.
+    The virtual registers are allocated to $t0-$t7 by a linear scan over their live intervals.
+    A virtual register is spilled to the stack only when no register is free at its definition.
+    The most used scalar variables (weighted by loop depth) are kept in $s0-$s7 and the $t registers
+    left over by the virtual registers, for the whole program.
+    Other variables, immediates and spilled virtual registers are loaded into the scratch registers $t8 and $t9 when used.
+    Each instruction is covered by the cheapest of the tiles matching it (a tree pattern of its operator over its
+    operands), counting the instructions loading the operands, so an immediate fitting the 16 bits of addiu, andi, ori,
+    xori, slti or a shift amount is taken by the instruction itself.
+    A conditional branch compares its two operands directly, with bltz, blez, bgtz or bgez against zero.
+    A multiply by a constant (2^m + 1) * 2^k or (2^m - 1) * 2^k, up to its sign, is lowered to shifts and adds,
+    a division by a power of two to shifts rounding toward zero, and other divisions by a constant to a
+    multiply-high by a magic number (Granlund and Montgomery).
+
+    The frame is laid out again after the allocation: only the arrays, the variables and the virtual registers
+    left in memory get a slot, and those whose live intervals do not overlap share one.
+    An array only accessed at constant indices has no place of its own: its elements are kept like variables.
+    An array accessed through a pointer of the loop optimizer is a single lw or sw at the element's offset from it.
+
+    The instructions are printed to a buffer first, and cleaned up by the peephole optimizer before the output.
+*/
+
+#include <map>
+#include <set>
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <tuple>
+#include <sstream>
+
+#include "mips_emitter.h"
+#include "cfg.h"
+#include "peephole.h"
+
+using namespace std;
+
+// the leaves of the tree patterns: an operand in a register, or an immediate of the range an instruction encodes
+enum operand_pattern {
+    PAT_REG,
+    PAT_SIMM16,         // -32768..32767
+    PAT_UIMM16,         // 0..65535
+    PAT_SIMM16_NEGATED, // its negation is a PAT_SIMM16, printed negated
+    PAT_SIMM16_PLUS_ONE,    // one more than it is a PAT_SIMM16, printed plus one
+    PAT_SHAMT,          // 0..31
+};
+
+// a tile covering an IR instruction, i.e. the tree of an operator over its two operands
+struct Tile {
+    ir_opcode op;
+    operand_pattern a, b;
+    int cost;           // in machine instructions, a pseudo-branch on two registers taking two
+    const char* code;   // the instructions, with %d the destination, %a and %b the operands, %l the target label
+};
+
+static const Tile tiles[] = {
+    {IR_ADD, PAT_REG, PAT_REG, 1, "addu %d, %a, %b"},
+    {IR_ADD, PAT_REG, PAT_SIMM16, 1, "addiu %d, %a, %b"},
+    {IR_ADD, PAT_SIMM16, PAT_REG, 1, "addiu %d, %b, %a"},
+    {IR_SUB, PAT_REG, PAT_REG, 1, "subu %d, %a, %b"},
+    {IR_SUB, PAT_REG, PAT_SIMM16_NEGATED, 1, "addiu %d, %a, %b"},
+    {IR_MUL, PAT_REG, PAT_REG, 1, "mul %d, %a, %b"},
+    {IR_DIV, PAT_REG, PAT_REG, 2, "div %a, %b\nmflo %d"},
+    {IR_REM, PAT_REG, PAT_REG, 2, "div %a, %b\nmfhi %d"},
+    {IR_SHL, PAT_REG, PAT_REG, 1, "sllv %d, %a, %b"},
+    {IR_SHL, PAT_REG, PAT_SHAMT, 1, "sll %d, %a, %b"},
+    {IR_SHR, PAT_REG, PAT_REG, 1, "srlv %d, %a, %b"},
+    {IR_SHR, PAT_REG, PAT_SHAMT, 1, "srl %d, %a, %b"},
+    {IR_AND, PAT_REG, PAT_REG, 1, "and %d, %a, %b"},
+    {IR_AND, PAT_REG, PAT_UIMM16, 1, "andi %d, %a, %b"},
+    {IR_AND, PAT_UIMM16, PAT_REG, 1, "andi %d, %b, %a"},
+    {IR_OR, PAT_REG, PAT_REG, 1, "or %d, %a, %b"},
+    {IR_OR, PAT_REG, PAT_UIMM16, 1, "ori %d, %a, %b"},
+    {IR_OR, PAT_UIMM16, PAT_REG, 1, "ori %d, %b, %a"},
+    // a == b: whether a - b (or a ^ b) is 0
+    {IR_EQ, PAT_REG, PAT_REG, 2, "subu %d, %a, %b\nsltiu %d, %d, 1"},
+    {IR_EQ, PAT_REG, PAT_SIMM16_NEGATED, 2, "addiu %d, %a, %b\nsltiu %d, %d, 1"},
+    {IR_EQ, PAT_SIMM16_NEGATED, PAT_REG, 2, "addiu %d, %b, %a\nsltiu %d, %d, 1"},
+    {IR_EQ, PAT_REG, PAT_UIMM16, 2, "xori %d, %a, %b\nsltiu %d, %d, 1"},
+    {IR_EQ, PAT_UIMM16, PAT_REG, 2, "xori %d, %b, %a\nsltiu %d, %d, 1"},
+    {IR_NE, PAT_REG, PAT_REG, 2, "subu %d, %a, %b\nsltu %d, $zero, %d"},
+    {IR_NE, PAT_REG, PAT_SIMM16_NEGATED, 2, "addiu %d, %a, %b\nsltu %d, $zero, %d"},
+    {IR_NE, PAT_SIMM16_NEGATED, PAT_REG, 2, "addiu %d, %b, %a\nsltu %d, $zero, %d"},
+    {IR_NE, PAT_REG, PAT_UIMM16, 2, "xori %d, %a, %b\nsltu %d, $zero, %d"},
+    {IR_NE, PAT_UIMM16, PAT_REG, 2, "xori %d, %b, %a\nsltu %d, $zero, %d"},
+    // the other comparisons are a < b, reversed or negated; a <= k is a < k + 1
+    {IR_LT, PAT_REG, PAT_REG, 1, "slt %d, %a, %b"},
+    {IR_LT, PAT_REG, PAT_SIMM16, 1, "slti %d, %a, %b"},
+    {IR_GT, PAT_REG, PAT_REG, 1, "slt %d, %b, %a"},
+    {IR_GT, PAT_SIMM16, PAT_REG, 1, "slti %d, %b, %a"},
+    {IR_LE, PAT_REG, PAT_REG, 2, "slt %d, %b, %a\nxori %d, %d, 1"},
+    {IR_LE, PAT_REG, PAT_SIMM16_PLUS_ONE, 1, "slti %d, %a, %b"},
+    {IR_LE, PAT_SIMM16, PAT_REG, 2, "slti %d, %b, %a\nxori %d, %d, 1"},
+    {IR_GE, PAT_REG, PAT_REG, 2, "slt %d, %a, %b\nxori %d, %d, 1"},
+    {IR_GE, PAT_REG, PAT_SIMM16, 2, "slti %d, %a, %b\nxori %d, %d, 1"},
+    {IR_GE, PAT_SIMM16_PLUS_ONE, PAT_REG, 1, "slti %d, %b, %a"},
+    // the branches on a comparison with an immediate set $t9, which the immediate does not take
+    {IR_BRANCH_EQ, PAT_REG, PAT_REG, 1, "beq %a, %b, %l"},
+    {IR_BRANCH_NE, PAT_REG, PAT_REG, 1, "bne %a, %b, %l"},
+    {IR_BRANCH_LT, PAT_REG, PAT_REG, 2, "blt %a, %b, %l"},
+    {IR_BRANCH_LT, PAT_REG, PAT_SIMM16, 2, "slti $t9, %a, %b\nbnez $t9, %l"},
+    {IR_BRANCH_LT, PAT_SIMM16_PLUS_ONE, PAT_REG, 2, "slti $t9, %b, %a\nbeqz $t9, %l"},
+    {IR_BRANCH_GT, PAT_REG, PAT_REG, 2, "bgt %a, %b, %l"},
+    {IR_BRANCH_GT, PAT_REG, PAT_SIMM16_PLUS_ONE, 2, "slti $t9, %a, %b\nbeqz $t9, %l"},
+    {IR_BRANCH_GT, PAT_SIMM16, PAT_REG, 2, "slti $t9, %b, %a\nbnez $t9, %l"},
+    {IR_BRANCH_LE, PAT_REG, PAT_REG, 2, "ble %a, %b, %l"},
+    {IR_BRANCH_LE, PAT_REG, PAT_SIMM16_PLUS_ONE, 2, "slti $t9, %a, %b\nbnez $t9, %l"},
+    {IR_BRANCH_LE, PAT_SIMM16, PAT_REG, 2, "slti $t9, %b, %a\nbeqz $t9, %l"},
+    {IR_BRANCH_GE, PAT_REG, PAT_REG, 2, "bge %a, %b, %l"},
+    {IR_BRANCH_GE, PAT_REG, PAT_SIMM16, 2, "slti $t9, %a, %b\nbeqz $t9, %l"},
+    {IR_BRANCH_GE, PAT_SIMM16_PLUS_ONE, PAT_REG, 2, "slti $t9, %b, %a\nbnez $t9, %l"},
+};
+
+class MipsEmitter {
+public:
+    MipsEmitter(const IRProgram& program, ostream& out, ostream* stats) : program(program), out(out), stats(stats) {}
+
+    void emit() {
+        find_loops();
+        find_indexed_arrays();
+        compute_live_intervals();
+        allocate_variables();
+        allocate_temporaries();
+        layout_frame();
+
+        for (int i = 0; i < (int)program.code.size(); i++) {
+            emit_instruction(program.code[i]);
+        }
+        if (stats) {
+            *stats << "constants: " << reduced_multiplies << " multiplies and " << reduced_divisions
+                   << " divisions by constants without mul or div\n";
+            *stats << "selection: " << folded_immediates << " immediates folded into instructions\n";
+        }
+        out << "main:\n";
+        out << optimize_mips(os.str(), stats);
+        out << "end:\n";
+        out << "\taddi $v0, $zero, 1\n";   // a placeholder instruction
+    }
+
+private:
+    static const int pool_size = 8;     // $t0-$t7 hold the virtual registers
+    static const int saved_registers = 8;   // $s0-$s7 hold the variables
+
+    const IRProgram& program;
+    ostream& out;
+    ostringstream os;   // the instructions before the peephole optimization
+    ostream* stats;
+
+    vector<pair<int, int>> loops;   // the loop start and the backward branch of every loop
+    set<int> indexed_arrays;        // the slot of the first element of every indexed array
+    vector<int> interval_start;     // the definition of each virtual register
+    vector<int> interval_end;       // the last instruction where each virtual register is live
+    int temp_pool_size;             // the number of $t registers needed by the virtual registers
+    map<int, string> variable_register;     // the register of each promoted variable, by its slot
+    vector<int> vreg_register;      // the register of each virtual register, -1 if spilled
+    int reduced_multiplies = 0;     // the multiplies and divisions by constants lowered without mul or div
+    int reduced_divisions = 0;
+    int folded_immediates = 0;      // the immediates taken by the instructions instead of a register
+    map<int, int> slot_offset;      // the offset from $sp of each variable (or array) left in memory, by its slot
+    vector<int> vreg_offset;        // the offset from $sp of each spilled virtual register
+
+    static string register_name(int reg_no) {
+        return "$t" + to_string(reg_no);
+    }
+
+    static bool is_array_operand(const IRInst& inst, const IROperand* opd) {
+        return ir_is_array_operand(inst, opd);
+    }
+
+    // the loops, from the backward jumps and branches closing them
+    void find_loops() {
+        ControlFlowGraph cfg(program.code);
+        for (const IRLoop& loop : cfg.loops) {
+            loops.push_back({loop.start, loop.end});
+        }
+    }
+
+    // the arrays indexed by variables stay in memory as a whole, the others only have their elements accessed
+    // at constant indices, each of which is a variable on its own
+    void find_indexed_arrays() {
+        set<int> indexed;
+        for (const IRInst& inst : program.code) {
+            if (inst.op == IR_LOAD_ELEM || inst.op == IR_LOAD_PTR) {
+                indexed.insert(program.array_of(inst.a.value)->first);
+            } else if (inst.op == IR_STORE_ELEM || inst.op == IR_STORE_PTR) {
+                indexed.insert(program.array_of(inst.dst.value)->first);
+            }
+        }
+        indexed_arrays = indexed;
+    }
+
+    // the offset from $sp of a slot left in memory, the elements of an indexed array are laid out from its first one
+    int frame_offset(int slot) {
+        const pair<int, int>* array = program.array_of(slot);
+        if (array != nullptr && indexed_arrays.count(array->first)) {
+            return slot_offset[array->first] + (slot - array->first);
+        }
+        return slot_offset[slot];
+    }
+
+    // whether the slot is an element of an indexed array
+    bool in_indexed_array(int slot) const {
+        const pair<int, int>* array = program.array_of(slot);
+        return array != nullptr && indexed_arrays.count(array->first);
+    }
+
+    // a virtual register is live from its definition to its last use,
+    // and through the end of every loop it is used in but defined before
+    void compute_live_intervals() {
+        interval_end.assign(program.vreg_home.size(), -1);
+        interval_start.assign(program.vreg_home.size(), -1);
+        for (int i = 0; i < (int)program.code.size(); i++) {
+            const IRInst& inst = program.code[i];
+            if (inst.dst.kind == OPD_VREG && interval_start[inst.dst.value] < 0) {
+                interval_start[inst.dst.value] = i;
+            }
+            for (const IROperand& opd : {inst.dst, inst.a, inst.b}) {
+                if (opd.kind == OPD_VREG) {
+                    interval_end[opd.value] = i;
+                }
+            }
+        }
+
+        // only the virtual registers live across a label can be live through a loop
+        vector<int> labels_before(program.code.size() + 1, 0);
+        for (int i = 0; i < (int)program.code.size(); i++) {
+            labels_before[i + 1] = labels_before[i] + (program.code[i].op == IR_LABEL);
+        }
+        vector<int> across_label;
+        for (int v = 0; v < (int)interval_end.size(); v++) {
+            if (interval_start[v] >= 0 && labels_before[interval_end[v] + 1] > labels_before[interval_start[v] + 1]) {
+                across_label.push_back(v);
+            }
+        }
+
+        bool changed = !across_label.empty();
+        while (changed) {
+            changed = false;
+            for (const pair<int, int>& loop : loops) {
+                for (int v : across_label) {
+                    if (interval_start[v] < loop.first && interval_end[v] >= loop.first && interval_end[v] < loop.second) {
+                        interval_end[v] = loop.second;
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        // the most virtual registers live at once, as the linear scan frees the operands before the definition
+        vector<int> live_change(program.code.size() + 1, 0);
+        for (int v = 0; v < (int)interval_end.size(); v++) {
+            if (interval_start[v] >= 0) {
+                live_change[interval_start[v]]++;
+                live_change[max(interval_end[v], interval_start[v] + 1)]--;
+            }
+        }
+        int live = 0;
+        temp_pool_size = 0;
+        for (int i = 0; i < (int)program.code.size(); i++) {
+            live += live_change[i];
+            temp_pool_size = max(temp_pool_size, live);
+        }
+        temp_pool_size = min(temp_pool_size, (int)pool_size);
+    }
+
+    // keep the most used scalar variables in registers for the whole program
+    // each use or definition weighs 10 times more per enclosing loop
+    void allocate_variables() {
+        vector<int> depth_change(program.code.size() + 1, 0);
+        for (const pair<int, int>& loop : loops) {
+            depth_change[loop.first]++;
+            depth_change[loop.second + 1]--;
+        }
+        map<int, double> weight;
+        int depth = 0;
+        for (int i = 0; i < (int)program.code.size(); i++) {
+            depth += depth_change[i];
+            const IRInst& inst = program.code[i];
+            double use_weight = pow(10.0, min(depth, 8));
+            for (const IROperand* opd : {&inst.dst, &inst.a, &inst.b}) {
+                // indexed arrays stay in memory, they are accessed by address
+                if (opd->kind == OPD_SLOT && !is_array_operand(inst, opd) && !in_indexed_array(opd->value)) {
+                    weight[opd->value] += use_weight;
+                }
+            }
+        }
+
+        vector<pair<double, int>> candidates;
+        for (const pair<const int, double>& slot_weight : weight) {
+            candidates.push_back({-slot_weight.second, slot_weight.first});
+        }
+        sort(candidates.begin(), candidates.end());
+
+        vector<string> registers;
+        for (int i = 0; i < saved_registers; i++) {
+            registers.push_back("$s" + to_string(i));
+        }
+        for (int i = temp_pool_size; i < pool_size; i++) {
+            registers.push_back(register_name(i));
+        }
+        for (int i = 0; i < (int)candidates.size() && i < (int)registers.size(); i++) {
+            variable_register[candidates[i].second] = registers[i];
+        }
+        if (stats) {
+            *stats << "registers: " << variable_register.size() << " of " << candidates.size() << " variables promoted\n";
+        }
+    }
+
+    // linear scan in the program order, the intervals ending at an instruction are freed before its definition
+    void allocate_temporaries() {
+        vreg_register.assign(program.vreg_home.size(), -1);
+        vector<vector<int>> ending(program.code.size());
+        for (int v = 0; v < (int)interval_end.size(); v++) {
+            if (interval_start[v] >= 0) {
+                ending[interval_end[v]].push_back(v);
+            }
+        }
+        bool register_free[pool_size];
+        for (int i = 0; i < pool_size; i++) {
+            register_free[i] = i < temp_pool_size;
+        }
+        int spilled = 0;
+        for (int i = 0; i < (int)program.code.size(); i++) {
+            for (int v : ending[i]) {
+                if (interval_start[v] < i && vreg_register[v] >= 0) {
+                    register_free[vreg_register[v]] = true;
+                }
+            }
+            const IROperand& dst = program.code[i].dst;
+            if (dst.kind != OPD_VREG || interval_start[dst.value] != i) {
+                continue;
+            }
+            for (int r = 0; r < pool_size; r++) {
+                if (register_free[r]) {
+                    register_free[r] = false;
+                    vreg_register[dst.value] = r;
+                    break;
+                }
+            }
+            if (vreg_register[dst.value] < 0) {
+                spilled++;
+            } else if (interval_end[dst.value] == i) {
+                // never used
+                register_free[vreg_register[dst.value]] = true;
+            }
+        }
+        if (stats) {
+            *stats << "registers: " << spilled << " of " << interval_end.size() << " temporaries spilled\n";
+        }
+    }
+
+    // give a slot to everything left in memory: the indexed arrays first, then the variables and the spilled
+    // virtual registers, which share a slot when their live intervals do not overlap
+    void layout_frame() {
+        int top = -4;
+        for (const pair<int, int>& array : program.arrays) {
+            if (indexed_arrays.count(array.first)) {
+                slot_offset[array.first] = top;
+                top -= 4 * array.second;
+            }
+        }
+
+        // a variable is live from its first to its last access, and through every loop it is accessed in
+        map<int, vector<int>> accesses;
+        for (int i = 0; i < (int)program.code.size(); i++) {
+            const IRInst& inst = program.code[i];
+            for (const IROperand* opd : {&inst.dst, &inst.a, &inst.b}) {
+                if (opd->kind == OPD_SLOT && !is_array_operand(inst, opd) && !in_indexed_array(opd->value)
+                    && variable_register.count(opd->value) == 0) {
+                    accesses[opd->value].push_back(i);
+                }
+            }
+        }
+        // the live intervals: start, end, whether it is a virtual register, and the variable's slot or the virtual register
+        vector<tuple<int, int, bool, int>> intervals;
+        for (const pair<const int, vector<int>>& variable : accesses) {
+            int start = variable.second.front(), end = variable.second.back();
+            for (const pair<int, int>& loop : loops) {
+                vector<int>::const_iterator it = lower_bound(variable.second.begin(), variable.second.end(), loop.first);
+                if (it != variable.second.end() && *it <= loop.second) {
+                    start = min(start, loop.first);
+                    end = max(end, loop.second);
+                }
+            }
+            intervals.push_back(make_tuple(start, end, false, variable.first));
+        }
+        for (int v = 0; v < (int)interval_end.size(); v++) {
+            if (interval_start[v] >= 0 && vreg_register[v] < 0) {
+                intervals.push_back(make_tuple(interval_start[v], interval_end[v], true, v));
+            }
+        }
+        sort(intervals.begin(), intervals.end());
+
+        vreg_offset.assign(program.vreg_home.size(), 0);
+        priority_queue<pair<int, int>, vector<pair<int, int>>, greater<pair<int, int>>> occupied;   // end, slot
+        priority_queue<int, vector<int>, greater<int>> free_slots;
+        int slots = 0;
+        for (const tuple<int, int, bool, int>& interval : intervals) {
+            while (!occupied.empty() && occupied.top().first < get<0>(interval)) {
+                free_slots.push(occupied.top().second);
+                occupied.pop();
+            }
+            int slot;
+            if (free_slots.empty()) {
+                slot = slots++;
+            } else {
+                slot = free_slots.top();
+                free_slots.pop();
+            }
+            occupied.push({get<1>(interval), slot});
+            int offset = top - 4 * slot;
+            if (get<2>(interval)) {
+                vreg_offset[get<3>(interval)] = offset;
+            } else {
+                slot_offset[get<3>(interval)] = offset;
+            }
+        }
+        if (stats) {
+            *stats << "frame: " << program.frame_size << " bytes before compaction, " << (-4 - top + 4 * slots) << " bytes after\n";
+        }
+    }
+
+    // the register holding the value of a source operand, loading it into `scratch` if necessary
+    string use_operand(IROperand opd, const string& scratch) {
+        switch (opd.kind)
+        {
+        case OPD_IMM:
+            if (opd.value == 0) {
+                return "$zero";
+            }
+            os << "\tli " << scratch << ", " << opd.value << "\n";
+            return scratch;
+        case OPD_SLOT:
+            if (variable_register.count(opd.value)) {
+                return variable_register[opd.value];
+            }
+            os << "\tlw " << scratch << ", " << frame_offset(opd.value) << "($sp)\n";
+            return scratch;
+        case OPD_VREG:
+            if (vreg_register[opd.value] >= 0) {
+                return register_name(vreg_register[opd.value]);
+            }
+            os << "\tlw " << scratch << ", " << vreg_offset[opd.value] << "($sp)\n";
+            return scratch;
+        default:
+            return "$zero";
+        }
+    }
+
+    // the register to compute the destination operand into
+    string define_operand(IROperand dst) {
+        if (dst.kind == OPD_VREG && vreg_register[dst.value] >= 0) {
+            return register_name(vreg_register[dst.value]);
+        }
+        if (dst.kind == OPD_SLOT && variable_register.count(dst.value)) {
+            return variable_register[dst.value];
+        }
+        return "$t8";
+    }
+
+    // store the computed destination operand, unless it is in a register
+    void finish_operand(IROperand dst, const string& reg) {
+        if (dst.kind == OPD_VREG && vreg_register[dst.value] < 0) {
+            os << "\tsw " << reg << ", " << vreg_offset[dst.value] << "($sp)\n";
+        } else if (dst.kind == OPD_SLOT && variable_register.count(dst.value) == 0) {
+            os << "\tsw " << reg << ", " << frame_offset(dst.value) << "($sp)\n";
+        }
+    }
+
+    // compute the address of element `index` of the array at slot `base` into `address` ($t9 by default),
+    // the element is then at `base(address)`
+    void element_address(const string& index, const string& address = "$t9") {
+        // subtract the base address by the offset*4
+        os << "\tsll $t9, " << index << ", 2\n";
+        os << "\tsubu " << address << ", $sp, $t9\n";
+    }
+
+    static bool fits_simm16(int64_t value) {
+        return value >= -32768 && value <= 32767;
+    }
+
+    static bool fits_uimm16(int64_t value) {
+        return value >= 0 && value <= 65535;
+    }
+
+    // the cost of an operand matching a leaf of a tile, in machine instructions, or -1 if it does not match
+    int pattern_cost(const IROperand& opd, operand_pattern pattern) {
+        if (pattern == PAT_REG) {
+            switch (opd.kind)
+            {
+            case OPD_IMM:
+                // $zero, li, or lui and ori
+                if (opd.value == 0) {
+                    return 0;
+                }
+                return fits_simm16(opd.value) || fits_uimm16(opd.value) || (opd.value & 0xffff) == 0 ? 1 : 2;
+            case OPD_SLOT:
+                return variable_register.count(opd.value) ? 0 : 1;
+            case OPD_VREG:
+                return vreg_register[opd.value] >= 0 ? 0 : 1;
+            default:
+                return 0;
+            }
+        }
+        if (opd.kind != OPD_IMM) {
+            return -1;
+        }
+        int64_t value = opd.value;
+        switch (pattern)
+        {
+        case PAT_SIMM16: return fits_simm16(value) ? 0 : -1;
+        case PAT_UIMM16: return fits_uimm16(value) ? 0 : -1;
+        case PAT_SIMM16_NEGATED: return fits_simm16(-value) ? 0 : -1;
+        case PAT_SIMM16_PLUS_ONE: return fits_simm16(value + 1) ? 0 : -1;
+        case PAT_SHAMT: return value >= 0 && value < 32 ? 0 : -1;
+        default: return -1;
+        }
+    }
+
+    // the cheapest tile covering an instruction, counting the instructions loading its operands into registers
+    const Tile& select_tile(const IRInst& inst) {
+        const Tile* best = nullptr;
+        int best_cost = 0;
+        for (const Tile& tile : tiles) {
+            if (tile.op != inst.op) {
+                continue;
+            }
+            int a = pattern_cost(inst.a, tile.a), b = pattern_cost(inst.b, tile.b);
+            if (a >= 0 && b >= 0 && (best == nullptr || tile.cost + a + b < best_cost)) {
+                best = &tile;
+                best_cost = tile.cost + a + b;
+            }
+        }
+        return *best;
+    }
+
+    // an operand as a leaf of a tile: a register, or the immediate taken by the instruction
+    string tile_operand(const IROperand& opd, operand_pattern pattern, const string& scratch) {
+        if (pattern == PAT_REG) {
+            return use_operand(opd, scratch);
+        }
+        folded_immediates++;
+        int64_t value = opd.value;
+        if (pattern == PAT_SIMM16_NEGATED) {
+            value = -value;
+        } else if (pattern == PAT_SIMM16_PLUS_ONE) {
+            value++;
+        }
+        return to_string(value);
+    }
+
+    // print the instructions of the tile covering an instruction
+    void emit_tile(const Tile& tile, const IRInst& inst) {
+        string a = tile_operand(inst.a, tile.a, "$t8");
+        string b = tile_operand(inst.b, tile.b, "$t9");
+        bool branch = inst.op >= IR_BRANCH_EQ && inst.op <= IR_BRANCH_GE;
+        string d = branch ? "" : define_operand(inst.dst);
+        string label = branch ? "label" + to_string(inst.dst.value) : "";
+        os << "\t";
+        for (const char* c = tile.code; *c; c++) {
+            if (*c == '\n') {
+                os << "\n\t";
+            } else if (*c != '%') {
+                os << *c;
+            } else {
+                c++;
+                os << (*c == 'd' ? d : *c == 'a' ? a : *c == 'b' ? b : label);
+            }
+        }
+        os << "\n";
+        if (!branch) {
+            finish_operand(inst.dst, d);
+        }
+    }
+
+    // the number of trailing zero bits of a non-zero value
+    static int trailing_zeros(uint32_t value) {
+        int k = 0;
+        while ((value & 1) == 0) {
+            value >>= 1;
+            k++;
+        }
+        return k;
+    }
+
+    static bool is_power_of_two(uint32_t value) {
+        return value != 0 && (value & (value - 1)) == 0;
+    }
+
+    // d = a * c, by shifts and adds if c is (2^m + 1) * 2^k or (2^m - 1) * 2^k up to its sign, otherwise by mul
+    void multiply_by_constant(const string& d, const string& a, int32_t c) {
+        bool negative = c < 0;
+        uint32_t magnitude = negative ? 0u - (uint32_t)c : c;
+        if (magnitude == 0) {
+            os << "\tli " << d << ", 0\n";
+            return;
+        }
+        int k = trailing_zeros(magnitude);
+        uint32_t odd = magnitude >> k;
+        if (odd == 1) {
+            os << "\tsll " << d << ", " << a << ", " << k << "\n";
+        } else if (is_power_of_two(odd - 1) || is_power_of_two(odd + 1)) {
+            bool plus = is_power_of_two(odd - 1);
+            int m = trailing_zeros(plus ? odd - 1 : odd + 1);
+            // a * odd into $t9, or right into d if there is no shift left; a - a * 2^m already has the sign
+            bool negated = negative && !plus;
+            string product = k == 0 && (!negative || negated) ? d : "$t9";
+            os << "\tsll $t9, " << a << ", " << m << "\n";
+            if (plus) {
+                os << "\taddu " << product << ", $t9, " << a << "\n";
+            } else if (negated) {
+                os << "\tsubu " << product << ", " << a << ", $t9\n";
+            } else {
+                os << "\tsubu " << product << ", $t9, " << a << "\n";
+            }
+            negative = negative && !negated;
+            if (product != d) {
+                os << "\tsll " << d << ", $t9, " << k << "\n";
+            }
+        } else {
+            string b = use_operand(ir_imm(c), "$t9");
+            os << "\tmul " << d << ", " << a << ", " << b << "\n";
+            return;
+        }
+        reduced_multiplies++;
+        if (negative) {
+            os << "\tsubu " << d << ", $zero, " << d << "\n";
+        }
+    }
+
+    // the magic number and the shift of a signed division by d, |d| >= 2, not a power of two
+    // (Granlund and Montgomery, as in Hacker's Delight 10-1)
+    static void division_magic(int32_t d, int32_t* magic, int* shift) {
+        const uint32_t two31 = 0x80000000u;
+        uint32_t ad = d < 0 ? 0u - (uint32_t)d : d;
+        uint32_t t = two31 + ((uint32_t)d >> 31);
+        uint32_t anc = t - 1 - t % ad;      // the absolute value of nc
+        int p = 31;
+        uint32_t q1 = two31 / anc, r1 = two31 - q1 * anc;   // 2^p / |nc| and its remainder
+        uint32_t q2 = two31 / ad, r2 = two31 - q2 * ad;     // 2^p / |d| and its remainder
+        uint32_t delta;
+        do {
+            p++;
+            q1 *= 2;
+            r1 *= 2;
+            if (r1 >= anc) {
+                q1++;
+                r1 -= anc;
+            }
+            q2 *= 2;
+            r2 *= 2;
+            if (r2 >= ad) {
+                q2++;
+                r2 -= ad;
+            }
+            delta = ad - r2;
+        } while (q1 < delta || (q1 == delta && r1 == 0));
+        *magic = (int32_t)(d < 0 ? 0u - (q2 + 1) : q2 + 1);
+        *shift = p - 32;
+    }
+
+    // d = a / c rounded toward zero, by shifts for a power of two and by a multiply-high by a magic number otherwise
+    void divide_by_constant(const string& d, const string& a, int32_t c) {
+        uint32_t magnitude = c < 0 ? 0u - (uint32_t)c : c;
+        if (c == 0 || c == INT32_MIN) {
+            // division by zero is left to the run time, and only INT_MIN / INT_MIN is non-zero
+            string b = use_operand(ir_imm(c), "$t9");
+            os << "\tdiv " << a << ", " << b << "\n";
+            os << "\tmflo " << d << "\n";
+            return;
+        }
+        reduced_divisions++;
+        if (magnitude == 1) {
+            if (c < 0) {
+                os << "\tsubu " << d << ", $zero, " << a << "\n";
+            } else if (d != a) {
+                os << "\tmove " << d << ", " << a << "\n";
+            }
+            return;
+        }
+        if (is_power_of_two(magnitude)) {
+            // a negative a is rounded up by adding 2^k - 1 before the shift
+            int k = trailing_zeros(magnitude);
+            if (k == 1) {
+                os << "\tsrl $t9, " << a << ", 31\n";
+            } else {
+                os << "\tsra $t9, " << a << ", 31\n";
+                os << "\tsrl $t9, $t9, " << 32 - k << "\n";
+            }
+            os << "\taddu $t9, " << a << ", $t9\n";
+            os << "\tsra " << d << ", $t9, " << k << "\n";
+            if (c < 0) {
+                os << "\tsubu " << d << ", $zero, " << d << "\n";
+            }
+            return;
+        }
+        int32_t magic;
+        int shift;
+        division_magic(c, &magic, &shift);
+        os << "\tli $t9, " << magic << "\n";
+        os << "\tmult " << a << ", $t9\n";
+        os << "\tmfhi $t9\n";
+        if (c > 0 && magic < 0) {
+            os << "\taddu $t9, $t9, " << a << "\n";
+        } else if (c < 0 && magic > 0) {
+            os << "\tsubu $t9, $t9, " << a << "\n";
+        }
+        if (shift > 0) {
+            os << "\tsra $t9, $t9, " << shift << "\n";
+        }
+        // add 1 to a negative quotient, rounding it toward zero
+        os << "\tsrl $t8, $t9, 31\n";
+        os << "\taddu " << d << ", $t9, $t8\n";
+    }
+
+    void emit_instruction(const IRInst& inst) {
+        switch (inst.op)
+        {
+        // binary operators
+        case IR_MUL:
+        case IR_DIV:
+            if (inst.b.kind == OPD_IMM || (inst.op == IR_MUL && inst.a.kind == OPD_IMM)) {
+                // by a constant, the other operand is loaded into $t8, leaving $t9 to the sequence
+                bool swapped = inst.b.kind != OPD_IMM;
+                string a = use_operand(swapped ? inst.b : inst.a, "$t8");
+                string d = define_operand(inst.dst);
+                int32_t c = swapped ? inst.a.value : inst.b.value;
+                if (inst.op == IR_MUL) {
+                    multiply_by_constant(d, a, c);
+                } else {
+                    divide_by_constant(d, a, c);
+                }
+                finish_operand(inst.dst, d);
+                break;
+            }
+            // fall through
+        case IR_ADD: case IR_SUB: case IR_REM:
+        case IR_SHL: case IR_SHR: case IR_AND: case IR_OR:
+        case IR_EQ: case IR_NE: case IR_LT: case IR_GT: case IR_LE: case IR_GE:
+            emit_tile(select_tile(inst), inst);
+            break;
+
+        // unary operators
+        case IR_NOT:
+        case IR_NEG:
+        case IR_MOV: {
+            if (inst.op == IR_MOV && inst.a.kind == OPD_IMM) {
+                // load the immediate directly into the destination
+                string d = define_operand(inst.dst);
+                os << "\tli " << d << ", " << inst.a.value << "\n";
+                finish_operand(inst.dst, d);
+                break;
+            }
+            string a = use_operand(inst.a, "$t8");
+            string d = define_operand(inst.dst);
+            if (inst.op == IR_NOT) {
+                os << "\tsltiu " << d << ", " << a << ", 1\n";
+            } else if (inst.op == IR_NEG) {
+                os << "\tsubu " << d << ", $zero, " << a << "\n";
+            } else if (d != a) {
+                os << "\tmove " << d << ", " << a << "\n";
+            }
+            finish_operand(inst.dst, d);
+            break;
+        }
+
+        // arrays
+        case IR_LOAD_ELEM: {
+            string i = use_operand(inst.b, "$t9");
+            element_address(i);
+            string d = define_operand(inst.dst);
+            os << "\tlw " << d << ", " << frame_offset(inst.a.value) << "($t9)\n";
+            finish_operand(inst.dst, d);
+            break;
+        }
+        case IR_STORE_ELEM: {
+            string v = use_operand(inst.b, "$t8");
+            string i = use_operand(inst.a, "$t9");
+            element_address(i);
+            os << "\tsw " << v << ", " << frame_offset(inst.dst.value) << "($t9)\n";
+            break;
+        }
+        case IR_ELEM_ADDR: {
+            string d = define_operand(inst.dst);
+            if (inst.a.kind == OPD_IMM && inst.a.value != 0 && fits_simm16(-4 * (int64_t)inst.a.value)) {
+                os << "\taddiu " << d << ", $sp, " << -4 * (int64_t)inst.a.value << "\n";
+                folded_immediates++;
+            } else if (inst.a.kind == OPD_IMM) {
+                string offset = use_operand(ir_imm((int32_t)(4u * inst.a.value)), "$t9");
+                os << "\tsubu " << d << ", $sp, " << offset << "\n";
+            } else {
+                element_address(use_operand(inst.a, "$t9"), d);
+            }
+            finish_operand(inst.dst, d);
+            break;
+        }
+        case IR_LOAD_PTR: {
+            string p = use_operand(inst.b, "$t9");
+            string d = define_operand(inst.dst);
+            os << "\tlw " << d << ", " << frame_offset(inst.a.value) << "(" << p << ")\n";
+            finish_operand(inst.dst, d);
+            break;
+        }
+        case IR_STORE_PTR: {
+            string v = use_operand(inst.b, "$t8");
+            string p = use_operand(inst.a, "$t9");
+            os << "\tsw " << v << ", " << frame_offset(inst.dst.value) << "(" << p << ")\n";
+            break;
+        }
+
+        // io
+        case IR_READ:
+            // load 5 in $v0
+            os << "\taddi $v0, $zero, 5\n";
+            os << "\tsyscall\n";
+            // store the result in $v0 to the variable
+            if (variable_register.count(inst.dst.value)) {
+                os << "\tmove " << variable_register[inst.dst.value] << ", $v0\n";
+            } else {
+                os << "\tsw $v0, " << frame_offset(inst.dst.value) << "($sp)\n";
+            }
+            break;
+        case IR_WRITE: {
+            // prepare the value in $a0
+            string a = use_operand(inst.a, "$t8");
+            os << "\tadd $a0, $zero, " << a << "\n";
+            // load 1 in $v0 and print the integer
+            os << "\taddi $v0, $zero, 1\n";
+            os << "\tsyscall\n";
+            // print newline character
+            os << "\taddi $v0, $zero, 11\n";
+            os << "\taddi $a0, $zero, 10\n";
+            os << "\tsyscall\n";
+            break;
+        }
+
+        // control flow
+        case IR_LABEL:
+            os << "label" << inst.a.value << ":\n";
+            break;
+        case IR_JUMP:
+            os << "\tb label" << inst.a.value << "\n";
+            break;
+        case IR_BRANCH_EQ: case IR_BRANCH_NE: case IR_BRANCH_LT:
+        case IR_BRANCH_GT: case IR_BRANCH_LE: case IR_BRANCH_GE: {
+            ir_opcode comparison = ir_comparison_of(inst.op);
+            int32_t taken;
+            if (inst.a.kind == OPD_IMM && inst.b.kind == OPD_IMM && ir_evaluate(comparison, inst.a.value, inst.b.value, &taken)) {
+                // a constant condition
+                if (taken) {
+                    os << "\tb label" << inst.dst.value << "\n";
+                }
+                break;
+            }
+            if (!(inst.a.kind == OPD_IMM && inst.a.value == 0) && !(inst.b.kind == OPD_IMM && inst.b.value == 0)) {
+                emit_tile(select_tile(inst), inst);
+                break;
+            }
+            // a comparison with zero
+            string a = use_operand(inst.a, "$t8");
+            string b = use_operand(inst.b, "$t9");
+            if (a == "$zero" && b != "$zero") {
+                // compare with zero on the right
+                swap(a, b);
+                comparison = ir_swap_comparison(comparison);
+            }
+            static const char* const mnemonics[] = {"beq", "bne", "blt", "bgt", "ble", "bge"};
+            static const char* const zero_mnemonics[] = {"beq", "bne", "bltz", "bgtz", "blez", "bgez"};
+            if (b == "$zero" && comparison != IR_EQ && comparison != IR_NE) {
+                os << "\t" << zero_mnemonics[comparison - IR_EQ] << " " << a << ", label" << inst.dst.value << "\n";
+            } else {
+                os << "\t" << mnemonics[comparison - IR_EQ] << " " << a << ", " << b << ", label" << inst.dst.value << "\n";
+            }
+            break;
+        }
+        case IR_RETURN:
+            os << "\tb end\n";
+            break;
+        }
+    }
+};
+
+void emit_mips(const IRProgram& program, ostream& os, ostream* stats) {
+    MipsEmitter emitter(program, os, stats);
+    emitter.emit();
+}
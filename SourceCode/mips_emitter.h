@@ -0,0 +1,15 @@
+/*
+    File: mips_emitter.h
+    Author: Jiaqi Li
+    The MIPS emitter for the Simplified C compiler, which prints the IR program as MIPS assembly.
+*/
+
+#pragma once
+
+#include <iostream>
+
+#include "ir.h"
+
+// print the whole program as MIPS assembly, starting from `main` and ending at `end`
+// the statistics of the register allocation and the frame layout are printed to `stats` if given
+void emit_mips(const IRProgram& program, std::ostream& os, std::ostream* stats = nullptr);
@@ -7,6 +7,7 @@
 #include "scanner.h"
 #include "parser.h"
 #include "semantic_routines.h"
+#include "token_ring.h"
 
 using namespace std;
 
@@ -15,8 +16,18 @@ static std::vector<std::string> idx_to_token_copy; // transform index number to
 class ProductionRule;
 class LROneParser;
 
+// the source of tokens consumed by the parser
+class TokenSource {
+public:
+    virtual ~TokenSource() {}
+    virtual void unget() = 0;
+    virtual parser_token get() = 0;
+    // should first call get_semantic_value() before get() to obtain the semantic value of the next token
+    virtual string get_semantic_value() = 0;
+};
+
 // simulate stream behavior but with tokens
-class TokenStream {
+class TokenStream : public TokenSource {
 public:
     vector<parser_token> tokens;
     vector<string> semantic_values;
@@ -50,7 +61,92 @@ public:
     }
 };
 
+// a token stream pulling one token at a time from a producer,
+// only the next token and the last consumed token (for unget) are kept
+class PullTokenStream : public TokenSource {
+public:
+    void unget() {
+        ungot = true;
+    }
+    parser_token get() {
+        if (ungot) {
+            ungot = false;
+            return last_token;
+        }
+        peek();
+        has_next = false;
+        last_token = next_token;
+        last_semantic_value.swap(next_semantic_value);
+        return last_token;
+    }
+    string get_semantic_value() {
+        if (ungot) {
+            return last_semantic_value;
+        }
+        peek();
+        return next_semantic_value;
+    }
+protected:
+    // produce the next token; returns false at the end of input
+    virtual bool fetch(int* tok, string* semantic_value) = 0;
+private:
+    bool has_next = false;  // whether `next_token` is fetched but not consumed yet
+    bool ungot = false;     // whether the last consumed token is put back
+    parser_token next_token, last_token;
+    string next_semantic_value, last_semantic_value;
+
+    // fetch the next token if it is not fetched yet
+    void peek() {
+        if (has_next) {
+            return;
+        }
+        int tok;
+        if (fetch(&tok, &next_semantic_value)) {
+            next_token = (parser_token)tok;
+        } else {
+            next_token = SCANEOF;
+            next_semantic_value = "SCANEOF";
+        }
+        has_next = true;
+    }
+};
 
+// fused scanning and parsing: tokens are scanned on demand of the parser
+class LexerTokenStream : public PullTokenStream {
+public:
+    LexerTokenStream(Lexer* lexer) : lexer(lexer) {}
+protected:
+    bool fetch(int* tok, string* semantic_value) {
+        return lexer->next(tok, semantic_value);
+    }
+private:
+    Lexer* lexer;
+};
+
+// pipelined scanning and parsing: tokens are consumed from the ring filled by the scanner thread
+class RingTokenStream : public PullTokenStream {
+public:
+    RingTokenStream(TokenRing* ring) : ring(ring) {}
+protected:
+    bool fetch(int* tok, string* semantic_value) {
+        return ring->pop(tok, semantic_value);
+    }
+private:
+    TokenRing* ring;
+};
+
+// the scanner thread of the pipelined mode
+static void scan_into_ring(Lexer* lexer, TokenRing* ring) {
+    int tok;
+    string semantic_value;
+    while (lexer->next(&tok, &semantic_value)) {
+        if (!ring->push(tok, semantic_value)) {
+            // the parser has stopped
+            break;
+        }
+    }
+    ring->close();
+}
 
 // a state in the LR(1) parser
 class ItemSet {
@@ -82,6 +178,8 @@ public:
 // the parser driver
 class LROneParser {
 public: 
+    LROneParser();
+
     set<ProductionRule> prod_rules; // all production rules
     vector<ItemSet*> parser_states;
 
@@ -91,16 +189,54 @@ public:
 
     map<parser_token, bool> derives_lambda;  // whether a nonterminal derives lambda
 
-    // add a production rule
-    void register_prod_rule(parser_token lhs, vector<parser_token> rhs, string descriptor = "");
+    // the semantic action and right-hand side length of each production rule, indexed by the rule number
+    vector<semantic_action> rule_actions;
+    vector<int> rule_rhs_sizes;
+
+    // add a production rule, bound to the semantic routine to run upon its reduction
+    void register_prod_rule(parser_token lhs, vector<parser_token> rhs, semantic_action action = ACT_AUTO_COPY);
 
     // returns the added or queryed state number
     pair<int, bool> add_or_query_state(set<ProductionRule> target);
 
     void construct_parser(parser_token start_rule_lhs, vector<parser_token> start_rule_rhs);
 
-    void parse(TokenStream* input_stream);
+    void parse(TokenSource* input_stream);
+
+    // operator precedence, using the value from cppreference.com
+    int precedence_table[100];
+
+    // hybrid mode: expressions are parsed by precedence climbing instead of the LR(1) states
+    bool hybrid_expressions = false;
+
+    // AST mode: the reductions only build the syntax tree, the code is generated by a separate pass
+    bool ast_mode = false;
+
+private:
+    // the number of the `exp` production rules kept out of the LR(1) states in hybrid mode,
+    // by the operator or leading token, -1 if none
+    int binary_exp_rules[100];
+    int unary_exp_rules[100];
+    int int_exp_rule = -1, id_exp_rule = -1, index_exp_rule = -1, paren_exp_rule = -1;
+
+    // move the `exp` production rules out of `prod_rules` and index them by their shape
+    void extract_expression_rules();
+
+    // run the semantic routine of a production rule
+    void reduce_semantics(int rule_index, stack<Semantic>* semantic_stack) {
+        if (ast_mode) {
+            build_ast(rule_actions[rule_index], rule_rhs_sizes[rule_index], semantic_stack);
+        } else {
+            codegen(rule_actions[rule_index], rule_rhs_sizes[rule_index], semantic_stack);
+        }
+    }
 
+    // precedence climbing; reduces an `exp` whose binary operators have at least `min_precedence`
+    // returns false on a syntax error
+    bool parse_expression(TokenSource* input_stream, int min_precedence, stack<Semantic>* semantic_stack);
+    bool parse_primary_expression(TokenSource* input_stream, stack<Semantic>* semantic_stack);
+    // consume the expected terminal and push its semantic value
+    bool expect_token(TokenSource* input_stream, parser_token expected, stack<Semantic>* semantic_stack);
 };
 // used for building binary tree in set data structure
 bool operator<(const ProductionRule& lhs, const ProductionRule& rhs) {
@@ -142,19 +278,13 @@ static void print_token_stack(vector<parser_token> token_stack, int pos) {
     cout << "\n\n";
 }
 
-void LROneParser::parse(TokenStream* input_stream) {
-    curr_state = 0;
-    stack<int> state_stack;
-    stack<parser_token> operator_stack;
-    stack<Semantic> semantic_stack;
-    state_stack.push(0);
-    parser_token next_token;
-    string next_semantic_value;
-    vector<parser_token> token_stack;
-
+LROneParser::LROneParser() {
+    for (int i = 0; i < 100; i++) {
+        precedence_table[i] = 0;
+        binary_exp_rules[i] = -1;
+        unary_exp_rules[i] = -1;
+    }
     // encode operator precedence, using the value from cppreference.com
-    map<parser_token, int> precedence_table;
-    
     precedence_table[PLUS] = 11;
     precedence_table[MINUS] = 11;
 
@@ -178,7 +308,17 @@ void LROneParser::parse(TokenStream* input_stream) {
     precedence_table[LTEQ] = 8;
     precedence_table[GTEQ] = 8;
     precedence_table[GT] = 8;
+}
 
+void LROneParser::parse(TokenSource* input_stream) {
+    curr_state = 0;
+    stack<int> state_stack;
+    stack<parser_token> operator_stack;
+    stack<Semantic> semantic_stack;
+    state_stack.push(0);
+    parser_token next_token;
+    string next_semantic_value;
+    vector<parser_token> token_stack;
 
     while (true) {
         next_semantic_value = input_stream->get_semantic_value();
@@ -186,6 +326,19 @@ void LROneParser::parse(TokenStream* input_stream) {
 
         // cout << "state: " << curr_state << "\t" << "next type: " << idx_to_token_copy[next_token] << "\t\t";
 
+        // in hybrid mode, hand the whole expression over to precedence climbing, then shift the reduced `exp`
+        if (hybrid_expressions && parser_states[curr_state]->goto_table[exp] != -1) {
+            input_stream->unget();
+            if (!parse_expression(input_stream, 0, &semantic_stack)) {
+                cout << "error" << endl;
+                return;
+            }
+            state_stack.push(parser_states[curr_state]->goto_table[exp]);
+            curr_state = state_stack.top();
+            token_stack.push_back(exp);
+            continue;
+        }
+
         bool can_shift = false;
         // check if can shift
         if (parser_states[curr_state]->goto_table[next_token] != -1) {
@@ -194,7 +347,7 @@ void LROneParser::parse(TokenStream* input_stream) {
         bool can_reduce = false;
         parser_token reduced_token;
         // check if can be reduced
-        for (auto rule : parser_states[curr_state]->all_prod_rules) {
+        for (const ProductionRule& rule : parser_states[curr_state]->all_prod_rules) {
             if (rule.is_end() && rule.lookaheads.count(next_token)) {
                 can_reduce = true;
                 reduced_token = rule.lhs;
@@ -218,7 +371,7 @@ void LROneParser::parse(TokenStream* input_stream) {
         }
 
         if (can_reduce) {
-            for (auto rule : parser_states[curr_state]->all_prod_rules) {
+            for (const ProductionRule& rule : parser_states[curr_state]->all_prod_rules) {
                 if (rule.is_end() && rule.lookaheads.count(next_token)) {
                     // perform reduce
                     reduced_token = rule.lhs;
@@ -240,7 +393,7 @@ void LROneParser::parse(TokenStream* input_stream) {
                         token_stack.pop_back();
                     }
 
-                    codegen(rule, &semantic_stack);
+                    reduce_semantics(rule.index, &semantic_stack);
 
                     for (int i = 0; i < rule.rhs.size(); i++) {
                         state_stack.pop();
@@ -285,13 +438,119 @@ void LROneParser::parse(TokenStream* input_stream) {
     }
 }
 
-void LROneParser::register_prod_rule(parser_token lhs, vector<parser_token> rhs, string descriptor) {
+bool LROneParser::parse_expression(TokenSource* input_stream, int min_precedence, stack<Semantic>* semantic_stack) {
+    if (!parse_primary_expression(input_stream, semantic_stack)) {
+        return false;
+    }
+    while (true) {
+        string op_semantic_value = input_stream->get_semantic_value();
+        parser_token op = input_stream->get();
+        int rule_idx = binary_exp_rules[op];
+        if (rule_idx == -1 || precedence_table[op] < min_precedence) {
+            // not an operator, or binds looser than the enclosing one: leave it to the caller
+            input_stream->unget();
+            return true;
+        }
+        semantic_stack->push(Semantic(op_semantic_value));
+        // operators are left associative, so the right operand only takes tighter operators
+        if (!parse_expression(input_stream, precedence_table[op] + 1, semantic_stack)) {
+            return false;
+        }
+        reduce_semantics(rule_idx, semantic_stack);
+    }
+}
+
+bool LROneParser::parse_primary_expression(TokenSource* input_stream, stack<Semantic>* semantic_stack) {
+    string semantic_value = input_stream->get_semantic_value();
+    parser_token tok = input_stream->get();
+    if (tok == INT_NUM && int_exp_rule != -1) {
+        semantic_stack->push(Semantic(semantic_value));
+        reduce_semantics(int_exp_rule, semantic_stack);
+        return true;
+    }
+    if (tok == ID && id_exp_rule != -1) {
+        semantic_stack->push(Semantic(semantic_value));
+        string next_semantic_value = input_stream->get_semantic_value();
+        if (input_stream->get() == LSQUARE && index_exp_rule != -1) {
+            // ID, LSQUARE, exp, RSQUARE
+            semantic_stack->push(Semantic(next_semantic_value));
+            if (!parse_expression(input_stream, 0, semantic_stack) || !expect_token(input_stream, RSQUARE, semantic_stack)) {
+                return false;
+            }
+            reduce_semantics(index_exp_rule, semantic_stack);
+        } else {
+            input_stream->unget();
+            reduce_semantics(id_exp_rule, semantic_stack);
+        }
+        return true;
+    }
+    if (tok == LPAR && paren_exp_rule != -1) {
+        semantic_stack->push(Semantic(semantic_value));
+        if (!parse_expression(input_stream, 0, semantic_stack) || !expect_token(input_stream, RPAR, semantic_stack)) {
+            return false;
+        }
+        reduce_semantics(paren_exp_rule, semantic_stack);
+        return true;
+    }
+    if (unary_exp_rules[tok] != -1) {
+        // a unary operator applies to the operand with tighter binary operators,
+        // same as the shift/reduce decision against the operator stack
+        semantic_stack->push(Semantic(semantic_value));
+        if (!parse_expression(input_stream, precedence_table[tok] + 1, semantic_stack)) {
+            return false;
+        }
+        reduce_semantics(unary_exp_rules[tok], semantic_stack);
+        return true;
+    }
+    return false;
+}
+
+bool LROneParser::expect_token(TokenSource* input_stream, parser_token expected, stack<Semantic>* semantic_stack) {
+    string semantic_value = input_stream->get_semantic_value();
+    if (input_stream->get() != expected) {
+        return false;
+    }
+    semantic_stack->push(Semantic(semantic_value));
+    return true;
+}
+
+void LROneParser::extract_expression_rules() {
+    for (auto it = prod_rules.begin(); it != prod_rules.end();) {
+        if (it->lhs != exp) {
+            it++;
+            continue;
+        }
+        const vector<parser_token>& rhs = it->rhs;
+        int idx = it->index;
+        if (rhs == vector<parser_token>{INT_NUM}) {
+            int_exp_rule = idx;
+        } else if (rhs == vector<parser_token>{ID}) {
+            id_exp_rule = idx;
+        } else if (rhs == vector<parser_token>{ID, LSQUARE, exp, RSQUARE}) {
+            index_exp_rule = idx;
+        } else if (rhs == vector<parser_token>{LPAR, exp, RPAR}) {
+            paren_exp_rule = idx;
+        } else if (rhs.size() == 2 && is_terminal_token(rhs[0]) && rhs[1] == exp) {
+            unary_exp_rules[rhs[0]] = idx;
+        } else if (rhs.size() == 3 && rhs[0] == exp && is_terminal_token(rhs[1]) && rhs[2] == exp) {
+            binary_exp_rules[rhs[1]] = idx;
+        } else {
+            // not expressible by precedence climbing, keep it in the LR(1) states
+            it++;
+            continue;
+        }
+        it = prod_rules.erase(it);
+    }
+}
+
+void LROneParser::register_prod_rule(parser_token lhs, vector<parser_token> rhs, semantic_action action) {
     ProductionRule new_rule;
     new_rule.lhs = lhs;
     new_rule.rhs = rhs;
     new_rule.dot_location = 0;
-    new_rule.index = prod_rules.size();
-    new_rule.descriptor = descriptor;
+    new_rule.index = rule_actions.size();
+    rule_actions.push_back(action);
+    rule_rhs_sizes.push_back(rhs.size());
     // new_rule.parser = this;
     // new_rule.lookaheads = NOTHING;
     prod_rules.insert(new_rule);
@@ -299,6 +558,10 @@ void LROneParser::register_prod_rule(parser_token lhs, vector<parser_token> rhs,
 
 // after adding production rules, construct the parser
 void LROneParser::construct_parser(parser_token start_rule_lhs, vector<parser_token> start_rule_rhs) {
+    if (hybrid_expressions) {
+        extract_expression_rules();
+    }
+
     // first, find out which nonterminals derive lambda
     set<parser_token> vocabulary;
     for (ProductionRule rule : prod_rules) {
@@ -571,12 +834,52 @@ ProductionRule ProductionRule::advance_dot() {
 
 int main(int argc, char const *argv[])
 {
-    if (argc < 2) {
+    string input_fname;
+    bool fused_mode = false;    // scan tokens on demand of the parser, instead of scanning the whole file first
+    bool pipelined_mode = false;    // scan tokens on a separate thread, concurrently with the parser
+    bool hybrid_mode = false;   // parse expressions by precedence climbing inside the LR(1) parser
+    bool ast_mode = false;  // build the syntax tree first, then generate the code in a separate pass
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--fused") {
+            fused_mode = true;
+        } else if (arg == "--pipelined") {
+            pipelined_mode = true;
+        } else if (arg == "--pratt") {
+            hybrid_mode = true;
+        } else if (arg == "--ast") {
+            ast_mode = true;
+        } else if (arg == "--stats") {
+            show_stats = true;
+        } else if (arg == "-o") {
+            if (i + 1 == argc) {
+                fprintf(stderr, "Missing output file!\n");
+                return 1;
+            }
+            output_fname = argv[++i];
+        } else {
+            input_fname = arg;
+        }
+    }
+    if (input_fname.empty()) {
         fprintf(stderr, "Missing input file!\n");
+        return 1;
     }
     stringstream ss;
     stringstream semantic_stream;
-    scanner_driver(string(argv[1]), &ss, &idx_to_token_copy, &semantic_stream);
+    Lexer* lexer = nullptr;
+    TokenRing* ring = nullptr;
+    thread scanner_thread;
+    if (pipelined_mode) {
+        // start scanning right away, overlapping with the parser construction
+        lexer = new Lexer(input_fname, &idx_to_token_copy);
+        ring = new TokenRing();
+        scanner_thread = thread(scan_into_ring, lexer, ring);
+    } else if (fused_mode) {
+        lexer = new Lexer(input_fname, &idx_to_token_copy);
+    } else {
+        scanner_driver(input_fname, &ss, &idx_to_token_copy, &semantic_stream);
+    }
 
     TokenStream tokens;    // store the scanned tokens, used by parser
 
@@ -604,7 +907,7 @@ int main(int argc, char const *argv[])
 
     // print out the scanned tokens
     // cout << "Scanned Tokens: " << endl;
-    while (true)
+    while (!fused_mode && !pipelined_mode)
     {
         int tok;
         string semantic_value;
@@ -625,85 +928,101 @@ int main(int argc, char const *argv[])
     }
 
     LROneParser parser;
-    parser.register_prod_rule(program, vector<parser_token>{var_declarations, statements}, "program1");
-    parser.register_prod_rule(program, vector<parser_token>{statements}, "program2");
+    parser.register_prod_rule(program, vector<parser_token>{var_declarations, statements}, ACT_PROGRAM1);
+    parser.register_prod_rule(program, vector<parser_token>{statements}, ACT_PROGRAM2);
     
     parser.register_prod_rule(var_declarations, vector<parser_token>{var_declaration}); // auto-copy
     parser.register_prod_rule(var_declarations, vector<parser_token>{var_declarations, var_declaration}); // auto-copy
-    parser.register_prod_rule(var_declaration, vector<parser_token>{INT, declaration_list, SEMI}, "var_decl");
+    parser.register_prod_rule(var_declaration, vector<parser_token>{INT, declaration_list, SEMI}, ACT_VAR_DECL);
     parser.register_prod_rule(declaration_list, vector<parser_token>{declaration}); // auto-copy
-    parser.register_prod_rule(declaration_list, vector<parser_token>{declaration_list, COMMA, declaration}, "decl_list");
+    parser.register_prod_rule(declaration_list, vector<parser_token>{declaration_list, COMMA, declaration}, ACT_DECL_LIST);
 
-    parser.register_prod_rule(declaration, vector<parser_token>{ID}, "id_decl");
-    parser.register_prod_rule(declaration, vector<parser_token>{ID, ASSIGN, INT_NUM}, "id_assign");
-    parser.register_prod_rule(declaration, vector<parser_token>{ID, LSQUARE, INT_NUM, RSQUARE}, "id_decl_array");
+    parser.register_prod_rule(declaration, vector<parser_token>{ID}, ACT_ID_DECL);
+    parser.register_prod_rule(declaration, vector<parser_token>{ID, ASSIGN, INT_NUM}, ACT_ID_ASSIGN);
+    parser.register_prod_rule(declaration, vector<parser_token>{ID, LSQUARE, INT_NUM, RSQUARE}, ACT_ID_DECL_ARRAY);
 
     parser.register_prod_rule(code_block, vector<parser_token>{statement}); // auto-copy
-    parser.register_prod_rule(code_block, vector<parser_token>{SCOPE_BEGIN, statements, SCOPE_END}, "code_block");
+    parser.register_prod_rule(code_block, vector<parser_token>{SCOPE_BEGIN, statements, SCOPE_END}, ACT_CODE_BLOCK);
 
     parser.register_prod_rule(statements, vector<parser_token>{statement}); // auto-copy
     parser.register_prod_rule(statements, vector<parser_token>{statements, statement}); // auto-copy
 
-    parser.register_prod_rule(statement, vector<parser_token>{assign_statement, SEMI}, "assign_statement");
+    parser.register_prod_rule(statement, vector<parser_token>{assign_statement, SEMI}, ACT_ASSIGN_STATEMENT);
     parser.register_prod_rule(statement, vector<parser_token>{control_statement}); // auto-copy
-    parser.register_prod_rule(statement, vector<parser_token>{read_write_statement, SEMI}, "read_write_statement");
+    parser.register_prod_rule(statement, vector<parser_token>{read_write_statement, SEMI}, ACT_READ_WRITE_STATEMENT);
     parser.register_prod_rule(statement, vector<parser_token>{SEMI}); // auto-copy
 
     parser.register_prod_rule(control_statement, vector<parser_token>{if_statement}); // auto-copy
     parser.register_prod_rule(control_statement, vector<parser_token>{while_statement}); // auto-copy
-    parser.register_prod_rule(control_statement, vector<parser_token>{do_while_statement, SEMI}, "do_while_statement");
-    parser.register_prod_rule(control_statement, vector<parser_token>{return_statement, SEMI}, "return_statement");
+    parser.register_prod_rule(control_statement, vector<parser_token>{do_while_statement, SEMI}, ACT_DO_WHILE_STATEMENT);
+    parser.register_prod_rule(control_statement, vector<parser_token>{return_statement, SEMI}, ACT_RETURN_STATEMENT);
 
     parser.register_prod_rule(read_write_statement, vector<parser_token>{read_statement}); // auto-copy
     parser.register_prod_rule(read_write_statement, vector<parser_token>{write_statement}); // auto-copy
 
-    parser.register_prod_rule(assign_statement, vector<parser_token>{ID, LSQUARE, exp, RSQUARE, ASSIGN, exp}, "assign1");
-    parser.register_prod_rule(assign_statement, vector<parser_token>{ID, ASSIGN, exp}, "assign2");
+    parser.register_prod_rule(assign_statement, vector<parser_token>{ID, LSQUARE, exp, RSQUARE, ASSIGN, exp}, ACT_ASSIGN1);
+    parser.register_prod_rule(assign_statement, vector<parser_token>{ID, ASSIGN, exp}, ACT_ASSIGN2);
 
     parser.register_prod_rule(if_statement, vector<parser_token>{if_stmt}); // auto-copy
-    parser.register_prod_rule(if_statement, vector<parser_token>{if_stmt, ELSE, code_block}, "if_else");
-
-    parser.register_prod_rule(SCOPE_BEGIN, vector<parser_token>{LBRACE}, "scope_begin");
-    parser.register_prod_rule(SCOPE_END, vector<parser_token>{RBRACE}, "scope_end");
-
-    parser.register_prod_rule(if_stmt, vector<parser_token>{IF, LPAR, exp, RPAR, code_block}, "if");
-    parser.register_prod_rule(while_statement, vector<parser_token>{WHILE, LPAR, exp, RPAR, code_block}, "while");
-    parser.register_prod_rule(do_while_statement, vector<parser_token>{DO, code_block, WHILE, LPAR, exp, RPAR}, "do_while");
-    parser.register_prod_rule(return_statement, vector<parser_token>{RETURN}, "return");
-    parser.register_prod_rule(read_statement, vector<parser_token>{READ, LPAR, ID, RPAR}, "read");
-    parser.register_prod_rule(write_statement, vector<parser_token>{WRITE, LPAR, exp, RPAR}, "write");
-
-
-    parser.register_prod_rule(exp, vector<parser_token>{INT_NUM}, "exp_int");
-    parser.register_prod_rule(exp, vector<parser_token>{ID}, "exp_id");
-    parser.register_prod_rule(exp, vector<parser_token>{ID, LSQUARE, exp, RSQUARE}, "id_idx");
-    parser.register_prod_rule(exp, vector<parser_token>{NOT_OP, exp}, "not_exp");
-    parser.register_prod_rule(exp, vector<parser_token>{exp, PLUS, exp}, "plus");
-    parser.register_prod_rule(exp, vector<parser_token>{exp, MINUS, exp}, "minus");
-    parser.register_prod_rule(exp, vector<parser_token>{exp, MUL_OP, exp}, "mul");
-    parser.register_prod_rule(exp, vector<parser_token>{exp, DIV_OP, exp}, "div");
-    parser.register_prod_rule(exp, vector<parser_token>{exp, SHL_OP, exp}, "shl");
-    parser.register_prod_rule(exp, vector<parser_token>{exp, SHR_OP, exp}, "shr");
-    parser.register_prod_rule(exp, vector<parser_token>{exp, AND_OP, exp}, "and");
-    parser.register_prod_rule(exp, vector<parser_token>{exp, OR_OP, exp}, "or");
-    parser.register_prod_rule(exp, vector<parser_token>{exp, ANDAND, exp}, "andand");
-    parser.register_prod_rule(exp, vector<parser_token>{exp, OROR, exp}, "oror");
-    parser.register_prod_rule(exp, vector<parser_token>{exp, EQ, exp}, "eq");
-    parser.register_prod_rule(exp, vector<parser_token>{exp, NOTEQ, exp}, "noteq");
-    parser.register_prod_rule(exp, vector<parser_token>{exp, LT, exp}, "lt");
-    parser.register_prod_rule(exp, vector<parser_token>{exp, GT, exp}, "gt");
-    parser.register_prod_rule(exp, vector<parser_token>{exp, LTEQ, exp}, "lteq");
-    parser.register_prod_rule(exp, vector<parser_token>{exp, GTEQ, exp}, "gteq");
-
-    parser.register_prod_rule(exp, vector<parser_token>{LPAR, exp, RPAR}, "parexp");
-
-    parser.register_prod_rule(exp, vector<parser_token>{MINUS, exp}, "minusexp");
-    parser.register_prod_rule(exp, vector<parser_token>{PLUS, exp}, "plusexp");
-
-
+    parser.register_prod_rule(if_statement, vector<parser_token>{if_stmt, ELSE, code_block}, ACT_IF_ELSE);
+
+    parser.register_prod_rule(SCOPE_BEGIN, vector<parser_token>{LBRACE}, ACT_SCOPE_BEGIN);
+    parser.register_prod_rule(SCOPE_END, vector<parser_token>{RBRACE}, ACT_SCOPE_END);
+
+    parser.register_prod_rule(if_stmt, vector<parser_token>{IF, LPAR, exp, RPAR, code_block}, ACT_IF);
+    parser.register_prod_rule(while_statement, vector<parser_token>{WHILE, LPAR, exp, RPAR, code_block}, ACT_WHILE);
+    parser.register_prod_rule(do_while_statement, vector<parser_token>{DO, code_block, WHILE, LPAR, exp, RPAR}, ACT_DO_WHILE);
+    parser.register_prod_rule(return_statement, vector<parser_token>{RETURN}, ACT_RETURN);
+    parser.register_prod_rule(read_statement, vector<parser_token>{READ, LPAR, ID, RPAR}, ACT_READ);
+    parser.register_prod_rule(write_statement, vector<parser_token>{WRITE, LPAR, exp, RPAR}, ACT_WRITE);
+
+
+    parser.register_prod_rule(exp, vector<parser_token>{INT_NUM}, ACT_EXP_INT);
+    parser.register_prod_rule(exp, vector<parser_token>{ID}, ACT_EXP_ID);
+    parser.register_prod_rule(exp, vector<parser_token>{ID, LSQUARE, exp, RSQUARE}, ACT_ID_IDX);
+    parser.register_prod_rule(exp, vector<parser_token>{NOT_OP, exp}, ACT_NOT_EXP);
+    parser.register_prod_rule(exp, vector<parser_token>{exp, PLUS, exp}, ACT_PLUS);
+    parser.register_prod_rule(exp, vector<parser_token>{exp, MINUS, exp}, ACT_MINUS);
+    parser.register_prod_rule(exp, vector<parser_token>{exp, MUL_OP, exp}, ACT_MUL);
+    parser.register_prod_rule(exp, vector<parser_token>{exp, DIV_OP, exp}, ACT_DIV);
+    parser.register_prod_rule(exp, vector<parser_token>{exp, SHL_OP, exp}, ACT_SHL);
+    parser.register_prod_rule(exp, vector<parser_token>{exp, SHR_OP, exp}, ACT_SHR);
+    parser.register_prod_rule(exp, vector<parser_token>{exp, AND_OP, exp}, ACT_AND);
+    parser.register_prod_rule(exp, vector<parser_token>{exp, OR_OP, exp}, ACT_OR);
+    parser.register_prod_rule(exp, vector<parser_token>{exp, ANDAND, exp}, ACT_ANDAND);
+    parser.register_prod_rule(exp, vector<parser_token>{exp, OROR, exp}, ACT_OROR);
+    parser.register_prod_rule(exp, vector<parser_token>{exp, EQ, exp}, ACT_EQ);
+    parser.register_prod_rule(exp, vector<parser_token>{exp, NOTEQ, exp}, ACT_NOTEQ);
+    parser.register_prod_rule(exp, vector<parser_token>{exp, LT, exp}, ACT_LT);
+    parser.register_prod_rule(exp, vector<parser_token>{exp, GT, exp}, ACT_GT);
+    parser.register_prod_rule(exp, vector<parser_token>{exp, LTEQ, exp}, ACT_LTEQ);
+    parser.register_prod_rule(exp, vector<parser_token>{exp, GTEQ, exp}, ACT_GTEQ);
+
+    parser.register_prod_rule(exp, vector<parser_token>{LPAR, exp, RPAR}, ACT_PAREXP);
+
+    parser.register_prod_rule(exp, vector<parser_token>{MINUS, exp}, ACT_MINUSEXP);
+    parser.register_prod_rule(exp, vector<parser_token>{PLUS, exp}, ACT_PLUSEXP);
+
+
+    parser.hybrid_expressions = hybrid_mode;
+    parser.ast_mode = ast_mode;
     parser.construct_parser(system_goal, vector<parser_token>{program, SCANEOF});
     // cout << "Parsing Process: \n";
-    parser.parse(&tokens);
+    if (pipelined_mode) {
+        RingTokenStream ring_stream(ring);
+        parser.parse(&ring_stream);
+        // stop the scanner in case parsing ended before the end of input
+        ring->cancel();
+        scanner_thread.join();
+        delete ring;
+        delete lexer;
+    } else if (fused_mode) {
+        LexerTokenStream lexer_stream(lexer);
+        parser.parse(&lexer_stream);
+        delete lexer;
+    } else {
+        parser.parse(&tokens);
+    }
 
     return 0;
 }
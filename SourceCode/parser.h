@@ -3,6 +3,7 @@
     Expose the parser tokens to the semantic routines file.
     Expose the `ProductionRule` class, which is used to represent the parsing status, 
     use in the LR(1) parser implementation and the semantic routines.
+    Expose the `semantic_action` ids, which bind each production rule to its semantic routine.
 */
 
 #pragma once
@@ -71,6 +72,29 @@ enum parser_token {
     SCOPE_END,
 };
 
+// the semantic routine to run upon the reduction of a production rule
+enum semantic_action {
+    ACT_AUTO_COPY = 0,  // no routine: pass on (and merge) the right-hand side semantics
+
+    // program
+    ACT_PROGRAM1, ACT_PROGRAM2,
+
+    // declarations
+    ACT_VAR_DECL, ACT_DECL_LIST, ACT_ID_DECL, ACT_ID_ASSIGN, ACT_ID_DECL_ARRAY,
+
+    // statements
+    ACT_CODE_BLOCK, ACT_SCOPE_BEGIN, ACT_SCOPE_END, ACT_ASSIGN_STATEMENT,
+    ACT_READ_WRITE_STATEMENT, ACT_DO_WHILE_STATEMENT, ACT_RETURN_STATEMENT,
+    ACT_ASSIGN1, ACT_ASSIGN2, ACT_IF, ACT_IF_ELSE, ACT_WHILE, ACT_DO_WHILE,
+    ACT_RETURN, ACT_READ, ACT_WRITE,
+
+    // expressions
+    ACT_EXP_INT, ACT_EXP_ID, ACT_ID_IDX, ACT_NOT_EXP, ACT_MINUSEXP, ACT_PLUSEXP,
+    ACT_PAREXP, ACT_PLUS, ACT_MINUS, ACT_MUL, ACT_DIV, ACT_SHL, ACT_SHR,
+    ACT_AND, ACT_OR, ACT_ANDAND, ACT_OROR, ACT_EQ, ACT_NOTEQ, ACT_LT, ACT_GT,
+    ACT_LTEQ, ACT_GTEQ,
+};
+
 inline bool is_terminal_token(parser_token tok) {
     return tok <= ID || tok == SCANEOF || tok == LAMBDA;
 }
@@ -89,14 +113,12 @@ public:
 
     int index;
 
-    bool is_end() {
+    bool is_end() const {
         return dot_location >= rhs.size();
     }
 
-    parser_token get_next_token() {
+    parser_token get_next_token() const {
         assert(!is_end());
         return rhs[dot_location];
     }
-
-    std::string descriptor;
 };
\ No newline at end of file
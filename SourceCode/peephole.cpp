@@ -0,0 +1,476 @@
+/*
+    File: peephole.cpp
+    Author: Jiaqi Li
+    The peephole optimizer for the Simplified C compiler
+
+    The emitted MIPS instructions are parsed back into an opcode and its operands, and two passes run until nothing changes:
+    - Within a basic block, the value held by each register and stack slot is numbered. A load from a slot whose value
+      is already in a register becomes a move (store-to-load forwarding), and a load, `li`, move or store that would
+      not change its destination is removed. So is a div of the values $hi and $lo already hold the division of,
+      which lets one div supply both the quotient and the remainder.
+    - Over the whole program, the live registers and stack slots are computed backward. Stores to dead slots and
+      instructions defining only dead registers are removed, and a move from a register that dies there is coalesced
+      into the instruction computing that register.
+
+    An access through an address other than $sp is an array element, which may be any slot in the frame.
+    A constant that does not fit in 16 bits is loaded by lui and ori once the program is printed.
+*/
+
+#include <map>
+#include <set>
+#include <vector>
+#include <cstdint>
+#include <sstream>
+
+#include "peephole.h"
+
+using namespace std;
+
+// an instruction or a label
+struct MipsLine {
+    bool is_label = false;
+    string op;              // the opcode, or the name of the label
+    vector<string> args;
+    bool removed = false;
+};
+
+class Peephole {
+public:
+    Peephole(const string& code) {
+        istringstream is(code);
+        string text;
+        while (getline(is, text)) {
+            parse_line(text);
+        }
+    }
+
+    void optimize() {
+        bool changed = true;
+        while (changed) {
+            changed = number_values();
+            changed = remove_dead_code() || changed;
+        }
+    }
+
+    string print() const {
+        ostringstream os;
+        for (const MipsLine& line : lines) {
+            if (line.is_label) {
+                os << line.op << ":\n";
+                continue;
+            }
+            if (line.op == "li") {
+                print_constant(os, line.args[0], stoll(line.args[1]));
+                continue;
+            }
+            os << "\t" << line.op;
+            for (int i = 0; i < (int)line.args.size(); i++) {
+                os << (i == 0 ? " " : ", ") << line.args[i];
+            }
+            os << "\n";
+        }
+        return os.str();
+    }
+
+    // load a constant into a register: by li if it fits in 16 bits, otherwise by lui and ori
+    static void print_constant(ostream& os, const string& reg, long long value) {
+        if (value >= -32768 && value <= 65535) {
+            os << "\tli " << reg << ", " << value << "\n";
+            return;
+        }
+        uint32_t bits = value;
+        os << "\tlui " << reg << ", " << (bits >> 16) << "\n";
+        if ((bits & 0xffff) != 0) {
+            os << "\tori " << reg << ", " << reg << ", " << (bits & 0xffff) << "\n";
+        }
+    }
+
+    void print_stats(ostream& stats) const {
+        stats << "peephole: " << forwarded << " loads forwarded from registers\n";
+        stats << "peephole: " << redundant << " redundant loads, moves, stores and divisions removed\n";
+        stats << "peephole: " << dead_stores << " dead stores removed\n";
+        stats << "peephole: " << dead_instructions << " dead instructions removed\n";
+        stats << "peephole: " << coalesced << " moves coalesced\n";
+    }
+
+private:
+    vector<MipsLine> lines;
+    // the number of instructions changed by each rule
+    int forwarded = 0, redundant = 0, dead_stores = 0, dead_instructions = 0, coalesced = 0;
+
+    void parse_line(const string& text) {
+        MipsLine line;
+        if (!text.empty() && text.back() == ':') {
+            line.is_label = true;
+            line.op = text.substr(0, text.size() - 1);
+            lines.push_back(line);
+            return;
+        }
+        istringstream is(text);
+        if (!(is >> line.op)) {
+            return;
+        }
+        string arg;
+        while (is >> arg) {
+            if (arg.back() == ',') {
+                arg.pop_back();
+            }
+            line.args.push_back(arg);
+        }
+        lines.push_back(line);
+    }
+
+    static bool is_branch(const MipsLine& line) {
+        return !line.is_label && (line.op[0] == 'b' || line.op == "j");
+    }
+
+    static bool is_memory(const MipsLine& line) {
+        return line.op == "lw" || line.op == "sw";
+    }
+
+    // whether the memory operand of a load or store is a stack slot, addressed directly from $sp
+    static bool is_stack_slot(const MipsLine& line) {
+        return is_memory(line) && line.args[1].find("($sp)") != string::npos;
+    }
+
+    // the register holding the address of a load or store
+    static string base_register(const MipsLine& line) {
+        const string& address = line.args[1];
+        return address.substr(address.find('(') + 1, address.size() - address.find('(') - 2);
+    }
+
+    // whether the instruction copies register `src` to register `dst`
+    static bool is_move(const MipsLine& line, string* dst, string* src) {
+        if (line.is_label) {
+            return false;
+        }
+        if (line.op == "move") {
+            *dst = line.args[0];
+            *src = line.args[1];
+            return true;
+        }
+        if (line.args.size() != 3 || line.args[2][0] != '$') {
+            return false;
+        }
+        // adding or or-ing $zero, or subtracting it
+        bool plus_zero = line.op == "add" || line.op == "addu" || line.op == "or";
+        bool minus_zero = line.op == "sub" || line.op == "subu";
+        if ((plus_zero || minus_zero) && line.args[2] == "$zero") {
+            *dst = line.args[0];
+            *src = line.args[1];
+            return true;
+        }
+        if (plus_zero && line.args[1] == "$zero") {
+            *dst = line.args[0];
+            *src = line.args[2];
+            return true;
+        }
+        return false;
+    }
+
+    // whether the instruction does nothing but define its registers
+    static bool is_pure(const MipsLine& line) {
+        return !line.is_label && !is_branch(line) && line.op != "sw" && line.op != "syscall";
+    }
+
+    // the registers defined by an instruction, $lo stands for both $hi and $lo
+    static vector<string> defined_registers(const MipsLine& line) {
+        if (line.is_label || is_branch(line) || line.op == "sw") {
+            return {};
+        }
+        if (line.op == "syscall") {
+            return {"$v0"};
+        }
+        if (line.op == "div" || line.op == "divu" || line.op == "mult" || line.op == "multu") {
+            return {"$lo"};
+        }
+        return {line.args[0]};
+    }
+
+    // the registers used by an instruction
+    static vector<string> used_registers(const MipsLine& line) {
+        vector<string> used;
+        if (line.is_label) {
+            return used;
+        }
+        if (line.op == "syscall") {
+            return {"$v0", "$a0"};
+        }
+        if (line.op == "mflo" || line.op == "mfhi") {
+            return {"$lo"};
+        }
+        if (is_memory(line)) {
+            if (line.op == "sw") {
+                used.push_back(line.args[0]);
+            }
+            used.push_back(base_register(line));
+            return used;
+        }
+        // the first operand is the destination, except for the branches and the instructions writing $hi and $lo
+        int first = is_branch(line) || defined_registers(line) == vector<string>{"$lo"} ? 0 : 1;
+        for (int i = first; i < (int)line.args.size(); i++) {
+            if (line.args[i][0] == '$' && line.args[i] != "$zero") {
+                used.push_back(line.args[i]);
+            }
+        }
+        return used;
+    }
+
+    // drop the removed lines
+    void compact() {
+        vector<MipsLine> kept;
+        for (MipsLine& line : lines) {
+            if (!line.removed) {
+                kept.push_back(line);
+            }
+        }
+        lines.swap(kept);
+    }
+
+    // value numbering within each basic block, see the file comment
+    bool number_values() {
+        map<string, int> value;             // the value number held by each register and stack slot
+        map<long long, int> constant_value; // the value number of each constant
+        map<int, long long> value_constant;
+        map<pair<int, int>, int> division_value;    // the value number of $lo after dividing each pair of values
+        int next_value = 0;
+        bool changed = false;
+
+        auto constant = [&](long long k) {
+            if (constant_value.count(k) == 0) {
+                constant_value[k] = next_value;
+                value_constant[next_value] = k;
+                next_value++;
+            }
+            return constant_value[k];
+        };
+        auto known = [&](const string& location) {
+            if (location == "$zero") {
+                return constant(0);
+            }
+            map<string, int>::iterator it = value.find(location);
+            return it == value.end() ? -1 : it->second;
+        };
+        auto value_of = [&](const string& location) {
+            int v = known(location);
+            if (v < 0) {
+                v = value[location] = next_value++;
+            }
+            return v;
+        };
+        auto remove = [&](MipsLine& line, int& counter) {
+            line.removed = true;
+            counter++;
+            changed = true;
+        };
+
+        for (MipsLine& line : lines) {
+            string dst, src;
+            if (line.is_label) {
+                // other blocks may jump here
+                value.clear();
+            } else if (line.op == "li") {
+                int v = constant(stoll(line.args[1]));
+                if (known(line.args[0]) == v) {
+                    remove(line, redundant);
+                } else {
+                    value[line.args[0]] = v;
+                }
+            } else if (is_move(line, &dst, &src)) {
+                int v = value_of(src);
+                if (known(dst) == v) {
+                    remove(line, redundant);
+                } else {
+                    value[dst] = v;
+                }
+            } else if (line.op == "lw" && is_stack_slot(line)) {
+                string slot = line.args[1];
+                int v = known(slot);
+                if (v >= 0 && known(line.args[0]) == v) {
+                    remove(line, redundant);
+                    continue;
+                }
+                if (v >= 0) {
+                    // the value is already in a register, or is a constant
+                    string holder;
+                    for (const pair<const string, int>& location : value) {
+                        if (location.second == v && location.first[0] == '$') {
+                            holder = location.first;
+                            break;
+                        }
+                    }
+                    if (!holder.empty() || value_constant.count(v)) {
+                        line.op = holder.empty() ? "li" : "move";
+                        line.args[1] = holder.empty() ? to_string(value_constant[v]) : holder;
+                        forwarded++;
+                        changed = true;
+                    }
+                }
+                value[line.args[0]] = value_of(slot);
+            } else if (line.op == "sw" && is_stack_slot(line)) {
+                int v = value_of(line.args[0]);
+                if (known(line.args[1]) == v) {
+                    remove(line, redundant);
+                } else {
+                    value[line.args[1]] = v;
+                }
+            } else if (line.op == "div" && line.args.size() == 2) {
+                pair<int, int> operands(value_of(line.args[0]), value_of(line.args[1]));
+                if (division_value.count(operands) == 0) {
+                    division_value[operands] = next_value++;
+                }
+                int v = division_value[operands];
+                if (known("$lo") == v) {
+                    remove(line, redundant);
+                } else {
+                    value["$lo"] = v;
+                }
+            } else if (line.op == "sw") {
+                // an array element may be any slot
+                for (map<string, int>::iterator it = value.begin(); it != value.end();) {
+                    it = it->first[0] == '$' ? next(it) : value.erase(it);
+                }
+            } else {
+                for (const string& reg : defined_registers(line)) {
+                    value[reg] = next_value++;
+                }
+            }
+        }
+        compact();
+        return changed;
+    }
+
+    // liveness over the whole program, see the file comment
+    bool remove_dead_code() {
+        // the basic blocks, which start at a label or after a branch
+        vector<int> block_start;
+        map<string, int> label_block;
+        for (int i = 0; i < (int)lines.size(); i++) {
+            if (i == 0 || lines[i].is_label || is_branch(lines[i - 1])) {
+                if (block_start.empty() || block_start.back() != i) {
+                    block_start.push_back(i);
+                }
+            }
+            if (lines[i].is_label) {
+                label_block[lines[i].op] = block_start.size() - 1;
+            }
+        }
+        int blocks = block_start.size();
+        block_start.push_back(lines.size());
+
+        // the successors of each block, a jump out of the program (to `end`) has none
+        vector<vector<int>> successors(blocks);
+        for (int b = 0; b < blocks; b++) {
+            const MipsLine& last = lines[block_start[b + 1] - 1];
+            if (is_branch(last) && label_block.count(last.args.back())) {
+                successors[b].push_back(label_block[last.args.back()]);
+            }
+            if (!(is_branch(last) && (last.op == "b" || last.op == "j")) && b + 1 < blocks) {
+                successors[b].push_back(b + 1);
+            }
+        }
+
+        set<string> all_slots;
+        for (const MipsLine& line : lines) {
+            if (is_stack_slot(line)) {
+                all_slots.insert(line.args[1]);
+            }
+        }
+
+        // solve the live registers and slots at the start of each block
+        vector<set<string>> live_in(blocks);
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (int b = blocks - 1; b >= 0; b--) {
+                set<string> live = live_out(b, successors, live_in);
+                for (int i = block_start[b + 1] - 1; i >= block_start[b]; i--) {
+                    transfer(lines[i], all_slots, &live);
+                }
+                if (live != live_in[b]) {
+                    live_in[b] = live;
+                    changed = true;
+                }
+            }
+        }
+
+        // remove the dead instructions backward in each block
+        bool removed = false;
+        for (int b = 0; b < blocks; b++) {
+            set<string> live = live_out(b, successors, live_in);
+            for (int i = block_start[b + 1] - 1; i >= block_start[b]; i--) {
+                MipsLine& line = lines[i];
+                string dst, src;
+                if (line.op == "sw" && is_stack_slot(line) && live.count(line.args[1]) == 0) {
+                    line.removed = true;
+                    dead_stores++;
+                    removed = true;
+                    continue;
+                }
+                vector<string> defined = defined_registers(line);
+                bool dead = is_pure(line) && !defined.empty();
+                for (const string& reg : defined) {
+                    dead = dead && live.count(reg) == 0;
+                }
+                if (dead) {
+                    line.removed = true;
+                    dead_instructions++;
+                    removed = true;
+                    continue;
+                }
+                if (is_move(line, &dst, &src) && i > block_start[b] && live.count(src) == 0 && src != "$zero") {
+                    // compute the value directly into the destination of the move
+                    MipsLine& previous = lines[i - 1];
+                    vector<string> previous_defined = defined_registers(previous);
+                    if (is_pure(previous) && previous_defined.size() == 1 && previous_defined[0] == src && previous.args[0] == src) {
+                        previous.args[0] = dst;
+                        line.removed = true;
+                        coalesced++;
+                        removed = true;
+                        continue;
+                    }
+                }
+                transfer(line, all_slots, &live);
+            }
+        }
+        compact();
+        return removed;
+    }
+
+    set<string> live_out(int block, const vector<vector<int>>& successors, const vector<set<string>>& live_in) const {
+        set<string> live;
+        for (int successor : successors[block]) {
+            live.insert(live_in[successor].begin(), live_in[successor].end());
+        }
+        return live;
+    }
+
+    // the live registers and slots before an instruction, from those after it
+    static void transfer(const MipsLine& line, const set<string>& all_slots, set<string>* live) {
+        for (const string& reg : defined_registers(line)) {
+            live->erase(reg);
+        }
+        if (line.op == "sw" && is_stack_slot(line)) {
+            live->erase(line.args[1]);
+        }
+        for (const string& reg : used_registers(line)) {
+            live->insert(reg);
+        }
+        if (line.op == "lw") {
+            if (is_stack_slot(line)) {
+                live->insert(line.args[1]);
+            } else {
+                live->insert(all_slots.begin(), all_slots.end());
+            }
+        }
+    }
+};
+
+string optimize_mips(const string& code, ostream* stats) {
+    Peephole peephole(code);
+    peephole.optimize();
+    if (stats) {
+        peephole.print_stats(*stats);
+    }
+    return peephole.print();
+}
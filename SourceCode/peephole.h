@@ -0,0 +1,14 @@
+/*
+    File: peephole.h
+    Author: Jiaqi Li
+    The peephole optimizer for the Simplified C compiler, which cleans up the emitted MIPS instructions.
+*/
+
+#pragma once
+
+#include <iostream>
+#include <string>
+
+// optimize the MIPS instructions in `code` (one instruction or label per line), and return the optimized code
+// the number of instructions changed by each rule is printed to `stats` if given
+std::string optimize_mips(const std::string& code, std::ostream* stats = nullptr);
@@ -1 +1 @@
-./parser $1
\ No newline at end of file
+./parser "$@"
\ No newline at end of file
@@ -143,6 +143,10 @@ public:
     // driver that matches the code to the DFA
     void match_code(istream* code_istream, ostream* token_ostream, ostream* semantic_ostream);
 
+    // match a single token, resuming from the current position of the code stream
+    // returns false when the end of input is reached without a token
+    bool match_next(istream* code_istream, int* token, string* semantic_value);
+
 };
 
 // Implementation part
@@ -596,28 +600,36 @@ void DFA::create_DFA(NFA* nfa) {
 // the driver function to match the code to the DFA given the code stream
 void DFA::match_code(istream* code_istream, ostream* token_ostream, ostream* semantic_ostream)
 {
-    // match the code to the DFA
-    int current_state = start_state;
+    int token;
     string semantic_value;  // the content of the token
+    while (match_next(code_istream, &token, &semantic_value)) {
+        *token_ostream << token << endl;
+        *semantic_ostream << semantic_value << endl;
+    }
+}
+
+// match the next token of the code to the DFA
+// the DFA always restarts from the start state, so the only state kept between calls is the stream position
+bool DFA::match_next(istream* code_istream, int* token, string* semantic_value)
+{
+    int current_state = start_state;
+    semantic_value->clear();
     while (true) {
         char ch = code_istream->get();
         if (code_istream->eof()) {
             // when seeing EOF, check if the current state is a final state
             if (current_state != start_state && dfa_states[current_state].final_state_token != NUL_TOKEN) {
-                *token_ostream << dfa_states[current_state].final_state_token << endl;
-                *semantic_ostream << semantic_value << endl;
+                *token = dfa_states[current_state].final_state_token;
+                return true;
             }
-            break;
+            return false;
         }
 
         // if seeing a whitespace, then check if the current state is a final state
         if (ch == ' ' || ch == '\n' || ch == '\r' || ch == '\0' || ch == '\t') {
             if (current_state != start_state && dfa_states[current_state].final_state_token != NUL_TOKEN) {
-                *token_ostream << dfa_states[current_state].final_state_token << endl;
-                *semantic_ostream << semantic_value << endl;
-                current_state = start_state;
-                semantic_value = "";
-                continue;
+                *token = dfa_states[current_state].final_state_token;
+                return true;
             } else {
                 continue;
             }
@@ -628,82 +640,104 @@ void DFA::match_code(istream* code_istream, ostream* token_ostream, ostream* sem
         // if the next character is not a valid transition, then check if the current state is a final state
         if (next_state != -1) {
             current_state = next_state;
-            semantic_value += ch;
+            *semantic_value += ch;
         }
         else {
-            *token_ostream << dfa_states[current_state].final_state_token << endl;
-            *semantic_ostream << semantic_value << endl;
-            current_state = start_state;
-            semantic_value = "";
+            *token = dfa_states[current_state].final_state_token;
             code_istream->unget();
+            return true;
         }
     }
 }
 
-// wraps the whole scanner, output token to an ostream
-void scanner_driver(string input_fname, std::ostream* token_ostream, std::vector<std::string>* idx_to_token_copy, std::ostream* semantic_ostream)
+// encode the token regexes into the nfa, and convert it into the dfa used for matching
+static void build_scanner(NFA* nfa, DFA* dfa, std::vector<std::string>* idx_to_token_copy)
 {
-    std::ifstream code_ifstream(input_fname);
-
     // encode the token name's corresponding index
     idx_to_token = {"NUL_TOKEN", "INT", "MAIN", "VOID", "BREAK", "DO", "ELSE", "IF", "WHILE", "RETURN", "READ", "WRITE", "LBRACE", "RBRACE", "LSQUARE", "RSQUARE", "LPAR", "RPAR", "SEMI", "PLUS", "MINUS", "MUL_OP", "DIV_OP", "AND_OP", "OR_OP", "NOT_OP", "ASSIGN", "LT", "GT", "SHL_OP", "SHR_OP", "EQ", "NOTEQ", "LTEQ", "GTEQ", "ANDAND", "OROR", "COMMA", "INT_NUM", "ID"};
     *idx_to_token_copy = idx_to_token;
 
-    // encode the regex into nfa
-    NFA nfa;
-
     // encode INT_NUM and ID
-    nfa.add_int_num_regex(INT_NUM);
+    nfa->add_int_num_regex(INT_NUM);
 
     // encode keywords
-    nfa.add_standard_regex("int", INT);
-    nfa.add_standard_regex("main", MAIN);
-    nfa.add_standard_regex("void", VOID);
-    nfa.add_standard_regex("break", BREAK);
-    nfa.add_standard_regex("do", DO);
-    nfa.add_standard_regex("else", ELSE);
-    nfa.add_standard_regex("if", IF);
-    nfa.add_standard_regex("while", WHILE);
-    nfa.add_standard_regex("return", RETURN);
-    nfa.add_standard_regex("scanf", READ);
-    nfa.add_standard_regex("printf", WRITE);
+    nfa->add_standard_regex("int", INT);
+    nfa->add_standard_regex("main", MAIN);
+    nfa->add_standard_regex("void", VOID);
+    nfa->add_standard_regex("break", BREAK);
+    nfa->add_standard_regex("do", DO);
+    nfa->add_standard_regex("else", ELSE);
+    nfa->add_standard_regex("if", IF);
+    nfa->add_standard_regex("while", WHILE);
+    nfa->add_standard_regex("return", RETURN);
+    nfa->add_standard_regex("scanf", READ);
+    nfa->add_standard_regex("printf", WRITE);
 
     // encode operators
-    nfa.add_standard_regex("{", LBRACE);
-    nfa.add_standard_regex("}", RBRACE);
-    nfa.add_standard_regex("[", LSQUARE);
-    nfa.add_standard_regex("]", RSQUARE);
-    nfa.add_standard_regex("(", LPAR);
-    nfa.add_standard_regex(")", RPAR);
-    nfa.add_standard_regex(";", SEMI);
-    nfa.add_standard_regex("+", PLUS);
-    nfa.add_standard_regex("-", MINUS);
-    nfa.add_standard_regex("*", MUL_OP);
-    nfa.add_standard_regex("/", DIV_OP);
-    nfa.add_standard_regex("&", AND_OP);
-    nfa.add_standard_regex("|", OR_OP);
-    nfa.add_standard_regex("!", NOT_OP);
-    nfa.add_standard_regex("=", ASSIGN);
-    nfa.add_standard_regex("<", LT);
-    nfa.add_standard_regex(">", GT);
-    nfa.add_standard_regex("<<", SHL_OP);
-    nfa.add_standard_regex(">>", SHR_OP);
-    nfa.add_standard_regex("==", EQ);
-    nfa.add_standard_regex("!=", NOTEQ);
-    nfa.add_standard_regex("<=", LTEQ);
-    nfa.add_standard_regex(">=", GTEQ);
-    nfa.add_standard_regex("&&", ANDAND);
-    nfa.add_standard_regex("||", OROR);
-    nfa.add_standard_regex(",", COMMA);
-
-    nfa.add_id_regex(ID);
+    nfa->add_standard_regex("{", LBRACE);
+    nfa->add_standard_regex("}", RBRACE);
+    nfa->add_standard_regex("[", LSQUARE);
+    nfa->add_standard_regex("]", RSQUARE);
+    nfa->add_standard_regex("(", LPAR);
+    nfa->add_standard_regex(")", RPAR);
+    nfa->add_standard_regex(";", SEMI);
+    nfa->add_standard_regex("+", PLUS);
+    nfa->add_standard_regex("-", MINUS);
+    nfa->add_standard_regex("*", MUL_OP);
+    nfa->add_standard_regex("/", DIV_OP);
+    nfa->add_standard_regex("&", AND_OP);
+    nfa->add_standard_regex("|", OR_OP);
+    nfa->add_standard_regex("!", NOT_OP);
+    nfa->add_standard_regex("=", ASSIGN);
+    nfa->add_standard_regex("<", LT);
+    nfa->add_standard_regex(">", GT);
+    nfa->add_standard_regex("<<", SHL_OP);
+    nfa->add_standard_regex(">>", SHR_OP);
+    nfa->add_standard_regex("==", EQ);
+    nfa->add_standard_regex("!=", NOTEQ);
+    nfa->add_standard_regex("<=", LTEQ);
+    nfa->add_standard_regex(">=", GTEQ);
+    nfa->add_standard_regex("&&", ANDAND);
+    nfa->add_standard_regex("||", OROR);
+    nfa->add_standard_regex(",", COMMA);
+
+    nfa->add_id_regex(ID);
 
     // create the DFA from the NFA
     // by converting the NFA to a DFA
+    dfa->create_DFA(nfa);
+}
+
+// wraps the whole scanner, output token to an ostream
+void scanner_driver(string input_fname, std::ostream* token_ostream, std::vector<std::string>* idx_to_token_copy, std::ostream* semantic_ostream)
+{
+    std::ifstream code_ifstream(input_fname);
+
+    NFA nfa;
     DFA dfa;
-    dfa.create_DFA(&nfa);
+    build_scanner(&nfa, &dfa, idx_to_token_copy);
 
     // match code to the DFA
     dfa.match_code(&code_ifstream, token_ostream, semantic_ostream);
     code_ifstream.close();
 }
+
+Lexer::Lexer(string input_fname, std::vector<std::string>* idx_to_token_copy)
+    : code_ifstream(input_fname)
+{
+    nfa = new NFA();
+    dfa = new DFA();
+    build_scanner(nfa, dfa, idx_to_token_copy);
+}
+
+Lexer::~Lexer()
+{
+    code_ifstream.close();
+    delete dfa;
+    delete nfa;
+}
+
+bool Lexer::next(int* token, std::string* semantic_value)
+{
+    return dfa->match_next(&code_ifstream, token, semantic_value);
+}
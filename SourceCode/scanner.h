@@ -9,6 +9,26 @@
 
 #include <vector>
 #include <string>
+#include <fstream>
+
+class NFA;
+class DFA;
 
 // prepare the `idx_to_token` names, and the feed the scanned tokens to the token ostream
 void scanner_driver(std::string input_fname, std::ostream* token_ostream, std::vector<std::string>* idx_to_token_copy, std::ostream* semantic_ostream);
+
+// pull-based scanner: tokens are matched one at a time from the input file, upon request of the parser
+class Lexer {
+public:
+    // build the scanner DFA and prepare the `idx_to_token` names
+    Lexer(std::string input_fname, std::vector<std::string>* idx_to_token_copy);
+    ~Lexer();
+
+    // scan the next token; returns false at the end of input
+    bool next(int* token, std::string* semantic_value);
+
+private:
+    std::ifstream code_ifstream;
+    NFA* nfa;
+    DFA* dfa;
+};
@@ -3,11 +3,24 @@
     Author: Jiaqi Li
     The semantic routines part for the Simplified C compiler
 
-    The semantic routines are used to generate the MIPS code for the input code.
+    The semantic routines are used to generate the IR code for the input code.
     The semantic routines are called upon reduction of a production rule.
+    Expression results are kept in virtual registers, each with its own home slot in the stack.
+    In AST mode, the reductions only build the syntax tree, and `generate` walks it once the program is reduced.
+    Each identifier is resolved to its stack slot once, when its semantic is created.
 */
 
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <fstream>
+
 #include "semantic_routines.h"
+#include "mips_emitter.h"
+#include "loop_optimizer.h"
+#include "ssa_optimizer.h"
+#include "memory_optimizer.h"
+#include "ast.h"
 
 using namespace std;
 
@@ -17,520 +30,817 @@ int next_mem_location = -4; // start from -4, because $sp is pointing to the top
 
 int label_no = 1;
 
+int SymbolTable::find(const string& key) const {
+    size_t hash = std::hash<string>()(key);
+    size_t mask = buckets.size() - 1;
+    for (size_t i = hash & mask; buckets[i] >= 0; i = (i + 1) & mask) {
+        const Symbol& symbol = symbols[buckets[i]];
+        if (symbol.hash == hash && symbol.name == key) {
+            return buckets[i];
+        }
+    }
+    return -1;
+}
+
+int SymbolTable::intern(const string& key) {
+    int found = find(key);
+    if (found >= 0) {
+        return found;
+    }
+    // keep the load under a half, so that the probes stay short
+    if (2 * (symbols.size() + 1) > buckets.size()) {
+        buckets.assign(2 * buckets.size(), -1);
+        size_t mask = buckets.size() - 1;
+        for (size_t s = 0; s < symbols.size(); s++) {
+            size_t i = symbols[s].hash & mask;
+            while (buckets[i] >= 0) {
+                i = (i + 1) & mask;
+            }
+            buckets[i] = s;
+        }
+    }
+    size_t hash = std::hash<string>()(key);
+    size_t mask = buckets.size() - 1;
+    size_t i = hash & mask;
+    while (buckets[i] >= 0) {
+        i = (i + 1) & mask;
+    }
+    buckets[i] = symbols.size();
+    symbols.push_back({key, hash, undeclared, -1});
+    return buckets[i];
+}
+
+int SymbolTable::operator[](const string& key) {
+    int symbol = intern(key);
+    if (symbols[symbol].slot == undeclared) {
+        add_symbol(key, next_mem_location);
+        next_mem_location -= 4;
+    }
+    return symbols[symbol].slot;
+}
+
+void SymbolTable::add_symbol(const string& key, int loc) {
+    bind(intern(key), loc, -1);
+}
+
+void SymbolTable::add_array(const string& key, const ArrayDescriptor& descriptor) {
+    descriptors.push_back(descriptor);
+    bind(intern(key), descriptor.base, descriptors.size() - 1);
+}
+
+const ArrayDescriptor* SymbolTable::array(const string& key) const {
+    int symbol = find(key);
+    if (symbol < 0 || symbols[symbol].array < 0) {
+        return nullptr;
+    }
+    return &descriptors[symbols[symbol].array];
+}
+
+void SymbolTable::bind(int symbol, int slot, int array) {
+    // a declaration outside of every scope is never undone
+    if (!scope_marks.empty()) {
+        undo_log.push_back({symbol, symbols[symbol].slot, symbols[symbol].array});
+    }
+    symbols[symbol].slot = slot;
+    symbols[symbol].array = array;
+}
+
+void SymbolTable::close_scope() {
+    size_t mark = scope_marks.back();
+    scope_marks.pop_back();
+    // restore the declarations shadowed by the scope, latest first
+    while (undo_log.size() > mark) {
+        const Binding& binding = undo_log.back();
+        symbols[binding.symbol].slot = binding.slot;
+        symbols[binding.symbol].array = binding.array;
+        undo_log.pop_back();
+    }
+}
+
+static vector<int> vreg_home;   // the stack slot of each virtual register
+static vector<pair<int, int>> arrays;   // the slot of the first element and the length of each array
+
+bool show_stats = false;
+string output_fname;
+
+// allocates the rope nodes in blocks, which live until the end of the compilation
+class RopeArena {
+public:
+    ~RopeArena() {
+        for (RopeNode* block : blocks) {
+            delete[] block;
+        }
+    }
+    RopeNode* allocate(RopeNode::kind_t kind, RopeNode* left = nullptr, RopeNode* right = nullptr) {
+        if (blocks.empty() || used == block_size) {
+            blocks.push_back(new RopeNode[block_size]);
+            used = 0;
+        }
+        RopeNode* node = &blocks.back()[used++];
+        node->kind = kind;
+        node->left = left;
+        node->right = right;
+        return node;
+    }
+private:
+    static const int block_size = 4096;
+    vector<RopeNode*> blocks;
+    int used = 0;
+};
+
+static RopeArena rope_arena;
+
+void InstructionList::push_back(const IRInst& instruction) {
+    RopeNode* leaf = rope_arena.allocate(RopeNode::LEAF);
+    leaf->instruction = instruction;
+    root = root ? rope_arena.allocate(RopeNode::CONCAT, root, leaf) : leaf;
+}
+
+void InstructionList::push_front(const IRInst& instruction) {
+    RopeNode* leaf = rope_arena.allocate(RopeNode::LEAF);
+    leaf->instruction = instruction;
+    root = root ? rope_arena.allocate(RopeNode::CONCAT, leaf, root) : leaf;
+}
+
+void InstructionList::append(const InstructionList& other) {
+    if (other.root) {
+        root = root ? rope_arena.allocate(RopeNode::CONCAT, root, other.root) : other.root;
+    }
+}
+
+void InstructionList::prepend(const InstructionList& other) {
+    if (other.root) {
+        root = root ? rope_arena.allocate(RopeNode::CONCAT, other.root, root) : other.root;
+    }
+}
+
+InstructionList::Position InstructionList::reserve() {
+    RopeNode* hole = rope_arena.allocate(RopeNode::HOLE);
+    root = root ? rope_arena.allocate(RopeNode::CONCAT, root, hole) : hole;
+    return hole;
+}
+
+void InstructionList::insert_at(Position position, const IRInst& instruction) {
+    RopeNode* leaf = rope_arena.allocate(RopeNode::LEAF);
+    leaf->instruction = instruction;
+    position->left = position->left ? rope_arena.allocate(RopeNode::CONCAT, position->left, leaf) : leaf;
+}
+
+// in-order traversal with an explicit stack, since the rope can be as deep as it is long
+void InstructionList::flatten(vector<IRInst>* out) const {
+    vector<const RopeNode*> pending;
+    if (root) {
+        pending.push_back(root);
+    }
+    while (!pending.empty()) {
+        const RopeNode* node = pending.back();
+        pending.pop_back();
+        switch (node->kind)
+        {
+        case RopeNode::LEAF:
+            out->push_back(node->instruction);
+            break;
+        case RopeNode::CONCAT:
+            pending.push_back(node->right);
+            pending.push_back(node->left);
+            break;
+        case RopeNode::HOLE:
+            if (node->left) {
+                pending.push_back(node->left);
+            }
+            break;
+        }
+    }
+}
+
 
-// store the value of semantics in $t{reg_no}
-static void get_semantic_value(Semantic semantic, int reg_no, Semantic *new_semantic) {
+// the IR operand holding the value of an expression semantic
+static IROperand get_operand(const Semantic& semantic) {
     switch (semantic.type)
     {
     case literal:
-        new_semantic->push_back_instruction("li $t" + to_string(reg_no) + ", " + to_string(semantic.value));
-        break;
+        return ir_imm(semantic.value);
     case expression:
-        new_semantic->push_back_instruction("lw $t" + to_string(reg_no) + ", " + to_string(semantic.mem_location) + "($sp)");
-        break;
+        return ir_vreg(semantic.vreg);
     case id:
-        new_semantic->push_back_instruction("lw $t" + to_string(reg_no) + ", " + to_string(symbol_table[semantic.variable_name]) + "($sp)");
-        break;
+        return ir_slot(semantic.slot);
     default:
-        break;
+        return ir_none();
+    }
+}
+
+// allocate a new virtual register with its home slot in the stack
+static int new_vreg() {
+    vreg_home.push_back(next_mem_location);
+    next_mem_location -= 4;
+    return vreg_home.size() - 1;
+}
+
+static int new_label() {
+    return label_no++;
+}
+
+// the descriptor of an indexed array
+static const ArrayDescriptor& array_descriptor(const string& array_name) {
+    const ArrayDescriptor* array = symbol_table.array(array_name);
+    if (array == nullptr) {
+        cout << "error: " << array_name << " is not an array" << endl;
+        exit(1);
+    }
+    return *array;
+}
+
+// the slot of an array element at a constant index, which is checked to be in the range of the array
+static int element_slot(const string& array_name, int index) {
+    const ArrayDescriptor& array = array_descriptor(array_name);
+    if (index < 0 || index >= array.length) {
+        cout << "error: index " << index << " is out of the range of array " << array_name << endl;
+        exit(1);
+    }
+    return array.base - index * array.element_size;
+}
+
+// unary operators: compute the result of the operand into a new virtual register
+static void unary_operation(ir_opcode op, Semantic* new_semantic) {
+    IROperand operand = get_operand(*new_semantic);
+    new_semantic->fold_operand = ir_none();
+    new_semantic->is_comparison = false;
+    new_semantic->register_need = max(new_semantic->register_need, 1);
+    new_semantic->type = expression;
+    new_semantic->vreg = new_vreg();
+    new_semantic->push_back_instruction(op, ir_vreg(new_semantic->vreg), operand);
+}
+
+static void make_literal(int value, Semantic* new_semantic) {
+    *new_semantic = Semantic();
+    new_semantic->type = literal;
+    new_semantic->value = value;
+}
+
+// algebraic identities of an operator whose rhs is the literal `constant`, such as x+0, x*1 and x*0
+// returns true if the result is found without computing
+static bool simplify_with_constant(ir_opcode op, const Semantic& lhs, int constant, Semantic* new_semantic) {
+    bool is_identity = false;
+    switch (op)
+    {
+    case IR_ADD: case IR_SUB: case IR_OR: is_identity = constant == 0; break;
+    case IR_MUL: case IR_DIV: is_identity = constant == 1; break;
+    case IR_AND: is_identity = constant == -1; break;
+    case IR_SHL: case IR_SHR: is_identity = (constant & 31) == 0; break;
+    default: break;
+    }
+    if (is_identity) {
+        *new_semantic = lhs;
+        return true;
+    }
+    // the result no longer depends on the lhs, which has no side effects
+    if ((op == IR_MUL || op == IR_AND) && constant == 0) {
+        make_literal(0, new_semantic);
+        return true;
+    }
+    if (op == IR_OR && constant == -1) {
+        make_literal(-1, new_semantic);
+        return true;
+    }
+    return false;
+}
+
+// identities of an operator on the same variable, such as x-x
+static bool simplify_same_variable(ir_opcode op, const Semantic& lhs, Semantic* new_semantic) {
+    switch (op)
+    {
+    case IR_AND: case IR_OR: *new_semantic = lhs; return true;
+    case IR_SUB: case IR_NE: case IR_LT: case IR_GT: make_literal(0, new_semantic); return true;
+    case IR_EQ: case IR_LE: case IR_GE: make_literal(1, new_semantic); return true;
+    default: return false;
     }
 }
 
-int Semantic::push_back_label() {
-    int label = label_no;
-    label_no++;
-    instructions.push_back("label" + to_string(label) + ":");
-    return label;
+// compute `lhs op rhs` into a new virtual register after the code of `new_semantic`
+static void push_back_result(ir_opcode op, IROperand lhs, IROperand rhs, Semantic* new_semantic) {
+    new_semantic->is_comparison = ir_is_comparison(op);
+    if (new_semantic->is_comparison) {
+        new_semantic->compare_prefix = new_semantic->instructions;
+        new_semantic->compare_op = op;
+        new_semantic->compare_lhs = lhs;
+        new_semantic->compare_rhs = rhs;
+    }
+    new_semantic->type = expression;
+    new_semantic->vreg = new_vreg();
+    new_semantic->push_back_instruction(op, ir_vreg(new_semantic->vreg), lhs, rhs);
 }
 
-static string get_next_label() {
-    return "label" + to_string(label_no);
+// binary operators: merge the code of both operands, and compute the result into a new virtual register
+// the operand needing more registers is evaluated first (Sethi-Ullman order), expressions have no side effects
+// literals are folded, and constant chains such as a + 1 + 2 are reassociated
+static void binary_operation(ir_opcode op, vector<Semantic>& semantic_values, Semantic* new_semantic) {
+    const Semantic* lhs_semantic = &semantic_values[0];
+    const Semantic* rhs_semantic = &semantic_values[2];
+    int32_t result;
+    if (lhs_semantic->type == literal && rhs_semantic->type == literal) {
+        if (ir_evaluate(op, lhs_semantic->value, rhs_semantic->value, &result)) {
+            make_literal(result, new_semantic);
+            return;
+        }
+    } else if (lhs_semantic->type == literal && ir_is_commutative(op)) {
+        // keep the literal on the right
+        swap(lhs_semantic, rhs_semantic);
+    }
+    if (lhs_semantic->type == literal && lhs_semantic->value == 0 && op == IR_SUB) {
+        *new_semantic = *rhs_semantic;
+        unary_operation(IR_NEG, new_semantic);
+        return;
+    }
+    if (lhs_semantic->type == id && rhs_semantic->type == id && lhs_semantic->slot == rhs_semantic->slot
+        && simplify_same_variable(op, *lhs_semantic, new_semantic)) {
+        return;
+    }
+
+    if (rhs_semantic->type == literal && lhs_semantic->type != literal) {
+        int constant = rhs_semantic->value;
+        if (op == IR_SUB) {
+            // x - c is x + (-c)
+            op = IR_ADD;
+            ir_evaluate(IR_NEG, constant, 0, &constant);
+        }
+        if (simplify_with_constant(op, *lhs_semantic, constant, new_semantic)) {
+            return;
+        }
+        bool is_associative = op == IR_ADD || op == IR_MUL || op == IR_AND || op == IR_OR;
+        *new_semantic = *lhs_semantic;
+        IROperand lhs;
+        if (is_associative && lhs_semantic->fold_operand.kind != OPD_NONE && lhs_semantic->fold_op == op) {
+            // (x op c1) op c2 is x op (c1 op c2)
+            ir_evaluate(op, lhs_semantic->fold_constant, constant, &constant);
+            new_semantic->instructions = lhs_semantic->fold_prefix;
+            lhs = lhs_semantic->fold_operand;
+            Semantic simplified;
+            if (simplify_with_constant(op, Semantic(), constant, &simplified)) {
+                if (simplified.type == literal) {
+                    *new_semantic = simplified;
+                    return;
+                }
+                // the constants cancel out, e.g. a + 1 - 1
+                new_semantic->fold_operand = ir_none();
+                new_semantic->is_comparison = false;
+                new_semantic->type = expression;
+                new_semantic->vreg = new_vreg();
+                new_semantic->push_back_instruction(IR_MOV, ir_vreg(new_semantic->vreg), lhs);
+                return;
+            }
+        } else {
+            lhs = get_operand(*lhs_semantic);
+        }
+        new_semantic->fold_prefix = new_semantic->instructions;
+        new_semantic->fold_operand = lhs;
+        new_semantic->fold_op = op;
+        new_semantic->fold_constant = constant;
+        new_semantic->register_need = max(lhs_semantic->register_need, 1);
+        push_back_result(op, lhs, ir_imm(constant), new_semantic);
+        return;
+    }
+
+    int lhs_need = lhs_semantic->register_need;
+    int rhs_need = rhs_semantic->register_need;
+    if (rhs_need > lhs_need) {
+        *new_semantic = *rhs_semantic;
+        new_semantic->merge_with(*lhs_semantic);
+    } else {
+        *new_semantic = *lhs_semantic;
+        new_semantic->merge_with(*rhs_semantic);
+    }
+    new_semantic->fold_operand = ir_none();
+    new_semantic->register_need = lhs_need == rhs_need ? lhs_need + 1 : max(lhs_need, rhs_need);
+    push_back_result(op, get_operand(*lhs_semantic), get_operand(*rhs_semantic), new_semantic);
 }
-static string get_nextnext_label() {
-    return "label" + to_string(label_no+1);
+
+// fill in the target of the pending jumps
+static void backpatch(const vector<PendingJump>& jumps, int label) {
+    for (const PendingJump& jump : jumps) {
+        IRInst instruction = jump.instruction;
+        (instruction.op == IR_JUMP ? instruction.a : instruction.dst) = ir_label(label);
+        InstructionList::insert_at(jump.position, instruction);
+    }
+}
+
+// an expression used as a condition is true if it is non-zero, and a comparison is tested without computing it
+static void to_condition(Semantic* semantic) {
+    if (semantic->type == condition) {
+        return;
+    }
+    if (semantic->type == expression && semantic->is_comparison) {
+        semantic->instructions = semantic->compare_prefix;
+        semantic->condition_op = semantic->compare_op;
+        semantic->condition_lhs = semantic->compare_lhs;
+        semantic->condition_rhs = semantic->compare_rhs;
+    } else {
+        semantic->condition_op = IR_NE;
+        semantic->condition_lhs = get_operand(*semantic);
+        semantic->condition_rhs = ir_imm(0);
+    }
+    semantic->is_comparison = false;
+    semantic->true_jumps.clear();
+    semantic->false_jumps.clear();
+    semantic->fold_operand = ir_none();
+    semantic->type = condition;
 }
 
-void codegen(ProductionRule rule, std::stack<Semantic> *semantic_stack) {
-    // generate mips code upon reduction
-    vector<Semantic> semantic_values;
-    for (auto tok : rule.rhs) {
-        semantic_values.insert(semantic_values.begin(), semantic_stack->top());
+// append the code of a condition, which jumps to `target` if its result is `sense` and falls through otherwise
+static void jump_on_condition(Semantic condition_semantic, bool sense, int target, Semantic* new_semantic) {
+    to_condition(&condition_semantic);
+    ir_opcode comparison = sense ? condition_semantic.condition_op : ir_negate_comparison(condition_semantic.condition_op);
+    condition_semantic.push_back_instruction(ir_branch_of(comparison), ir_label(target), condition_semantic.condition_lhs, condition_semantic.condition_rhs);
+    backpatch(sense ? condition_semantic.true_jumps : condition_semantic.false_jumps, target);
+    const vector<PendingJump>& fall_through = sense ? condition_semantic.false_jumps : condition_semantic.true_jumps;
+    if (!fall_through.empty()) {
+        int next_label = new_label();
+        condition_semantic.push_back_label(next_label);
+        backpatch(fall_through, next_label);
+    }
+    new_semantic->merge_with(condition_semantic);
+}
+
+// a condition used as a value is computed as 0 or 1 on its two paths
+static void materialize(Semantic* semantic) {
+    if (semantic->type != condition) {
+        return;
+    }
+    int false_label = new_label();
+    int end_label = new_label();
+    int vreg = new_vreg();
+    Semantic value;
+    jump_on_condition(*semantic, false, false_label, &value);
+    value.push_back_instruction(IR_MOV, ir_vreg(vreg), ir_imm(1));
+    value.push_back_instruction(IR_JUMP, ir_none(), ir_label(end_label));
+    value.push_back_label(false_label);
+    value.push_back_instruction(IR_MOV, ir_vreg(vreg), ir_imm(0));
+    value.push_back_label(end_label);
+    value.type = expression;
+    value.vreg = vreg;
+    value.register_need = max(semantic->register_need, 1);
+    *semantic = value;
+}
+
+// && and ||: the rhs is skipped once the lhs decides the result, by jumping to the target of the whole expression
+static void logical_operation(bool is_and, vector<Semantic>& semantic_values, Semantic* new_semantic) {
+    Semantic lhs = semantic_values[0];
+    Semantic rhs = semantic_values[2];
+    if (lhs.type == literal || rhs.type == literal) {
+        // a literal either decides the result (0 for && and non-zero for ||), or leaves it to the other operand
+        // the other operand has no side effects
+        const Semantic& constant = lhs.type == literal ? lhs : rhs;
+        const Semantic& other = lhs.type == literal ? rhs : lhs;
+        if ((constant.value != 0) != is_and) {
+            make_literal(is_and ? 0 : 1, new_semantic);
+        } else if (other.type == literal) {
+            make_literal(other.value != 0, new_semantic);
+        } else {
+            *new_semantic = other;
+            to_condition(new_semantic);
+        }
+        return;
+    }
+
+    to_condition(&lhs);
+    to_condition(&rhs);
+    *new_semantic = lhs;
+    new_semantic->true_jumps.clear();
+    new_semantic->false_jumps.clear();
+    // the lhs decides the result of && if it is false, and that of || if it is true
+    vector<PendingJump>& decided = is_and ? new_semantic->false_jumps : new_semantic->true_jumps;
+    decided = is_and ? lhs.false_jumps : lhs.true_jumps;
+    ir_opcode comparison = is_and ? ir_negate_comparison(lhs.condition_op) : lhs.condition_op;
+    decided.push_back(PendingJump{new_semantic->instructions.reserve(),
+        IRInst{ir_branch_of(comparison), ir_none(), lhs.condition_lhs, lhs.condition_rhs}});
+    // otherwise the rhs decides it
+    const vector<PendingJump>& undecided = is_and ? lhs.true_jumps : lhs.false_jumps;
+    if (!undecided.empty()) {
+        int rhs_label = new_label();
+        new_semantic->push_back_label(rhs_label);
+        backpatch(undecided, rhs_label);
+    }
+    new_semantic->merge_with(rhs);
+    new_semantic->true_jumps.insert(new_semantic->true_jumps.end(), rhs.true_jumps.begin(), rhs.true_jumps.end());
+    new_semantic->false_jumps.insert(new_semantic->false_jumps.end(), rhs.false_jumps.begin(), rhs.false_jumps.end());
+    new_semantic->condition_op = rhs.condition_op;
+    new_semantic->condition_lhs = rhs.condition_lhs;
+    new_semantic->condition_rhs = rhs.condition_rhs;
+    new_semantic->register_need = max(lhs.register_need, rhs.register_need);
+}
+
+// while loop: test the condition at the start, and jump back after the body
+static void lower_while(const Semantic& condition, const Semantic& body, int start_label, int end_label, Semantic* new_semantic) {
+    new_semantic->push_back_label(start_label);
+    // if false, jump to the end of the loop
+    jump_on_condition(condition, false, end_label, new_semantic);
+    new_semantic->merge_with(body);
+    new_semantic->push_back_instruction(IR_JUMP, ir_none(), ir_label(start_label));
+    new_semantic->push_back_label(end_label);
+}
+
+// do-while loop: run the body, then test the condition
+static void lower_do_while(const Semantic& body, const Semantic& condition, int start_label, int end_label, Semantic* new_semantic) {
+    new_semantic->push_back_label(start_label);
+    new_semantic->merge_with(body);
+    // if true, jump back to the start of the loop, a single branch per iteration
+    jump_on_condition(condition, true, start_label, new_semantic);
+    new_semantic->push_back_label(end_label);
+}
+
+// print the whole program with the emitter
+static void finish_program(const Semantic& program_semantic) {
+    IRProgram program;
+    program_semantic.instructions.flatten(&program.code);
+    program.vreg_home = vreg_home;
+    program.arrays = arrays;
+    program.frame_size = -4 - next_mem_location;
+    reduce_induction_variables(&program, show_stats ? &cerr : nullptr);
+    hoist_loop_invariants(&program, show_stats ? &cerr : nullptr);
+    optimize_ssa(&program, show_stats ? &cerr : nullptr);
+    eliminate_dead_stores(&program, show_stats ? &cerr : nullptr);
+    if (output_fname.empty()) {
+        emit_mips(program, cout, show_stats ? &cerr : nullptr);
+        return;
+    }
+    // the file is written through a large buffer, flushed once it is full and when it is closed
+    vector<char> buffer(1 << 20);
+    ofstream file;
+    file.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+    file.open(output_fname);
+    if (file) {
+        emit_mips(program, file, show_stats ? &cerr : nullptr);
+        file.close();
+    }
+    if (!file) {
+        cerr << "error: cannot write " << output_fname << endl;
+        exit(1);
+    }
+}
+
+void codegen(semantic_action action, int rhs_size, std::stack<Semantic> *semantic_stack) {
+    // generate IR code upon reduction
+    vector<Semantic> semantic_values(rhs_size);
+    for (int i = rhs_size - 1; i >= 0; i--) {
+        semantic_values[i] = std::move(semantic_stack->top());
         semantic_stack->pop();
     }
 
+    // logical expressions stay lowered to jumps in the routines taking a condition, the others take their value
+    bool takes_condition = action == ACT_ANDAND || action == ACT_OROR || action == ACT_NOT_EXP || action == ACT_PAREXP
+        || action == ACT_PLUSEXP || action == ACT_IF || action == ACT_WHILE || action == ACT_DO_WHILE
+        || (action == ACT_AUTO_COPY && rhs_size == 1);
+    if (!takes_condition) {
+        for (Semantic& semantic_value : semantic_values) {
+            materialize(&semantic_value);
+        }
+    }
+
     Semantic new_semantic;
 
+    switch (action)
+    {
     // declarations
-    if (rule.descriptor == "id_decl") {
+    case ACT_ID_DECL: {
         // create a new symbol table entry
         symbol_table.add_symbol(semantic_values[0].raw_value, next_mem_location);
         next_mem_location -= 4;
         new_semantic.type = id;
-        new_semantic.variable_name = semantic_values[0].raw_value;
+        new_semantic.slot = symbol_table[semantic_values[0].raw_value];
         // store 0 in the memory location
-        new_semantic.push_back_instruction("li $t0, 0");
-        new_semantic.push_back_instruction("sw $t0, " + to_string(symbol_table[semantic_values[0].raw_value]) + "($sp)");
+        new_semantic.push_back_instruction(IR_MOV, ir_slot(new_semantic.slot), ir_imm(0));
+        break;
     }
-    if (rule.descriptor == "id_assign") {
+    case ACT_ID_ASSIGN: {
         // create a new symbol table entry
         symbol_table.add_symbol(semantic_values[0].raw_value, next_mem_location);
         next_mem_location -= 4;
         new_semantic.type = id;
-        new_semantic.variable_name = semantic_values[0].raw_value;
+        new_semantic.slot = symbol_table[semantic_values[0].raw_value];
         // store the int in the memory location
-        new_semantic.push_back_instruction("li $t0, " + semantic_values[2].raw_value);
-        new_semantic.push_back_instruction("sw $t0, " + to_string(symbol_table[semantic_values[0].raw_value]) + "($sp)");
-    }
-    else if (rule.descriptor == "id_decl_array") {
-        // create symbol table entries for the array
-        for (int i = 0; i < stoi(semantic_values[2].raw_value); i++) {
-            symbol_table.add_symbol(semantic_values[0].raw_value + "[" + to_string(i) + "]", next_mem_location);
-            next_mem_location -= 4;
-        }
+        new_semantic.push_back_instruction(IR_MOV, ir_slot(new_semantic.slot), ir_imm(stoi(semantic_values[2].raw_value)));
+        break;
+    }
+    case ACT_ID_DECL_ARRAY: {
+        // a single symbol table entry describes the whole array
+        ArrayDescriptor array = {next_mem_location, stoi(semantic_values[2].raw_value), 4};
+        symbol_table.add_array(semantic_values[0].raw_value, array);
+        next_mem_location -= array.length * array.element_size;
+        arrays.push_back({array.base, array.length});
         new_semantic.type = id;
-        new_semantic.variable_name = semantic_values[0].raw_value;
+        new_semantic.slot = array.base;
+        break;
     }
 
     // derive expressions
-    else if (rule.descriptor == "exp_int") {
+    case ACT_EXP_INT: {
         new_semantic.type = literal;
         new_semantic.value = stoi(semantic_values[0].raw_value);
+        break;
     }
-    else if (rule.descriptor == "exp_id") {
+    case ACT_EXP_ID: {
         new_semantic.type = id;
-        new_semantic.variable_name = semantic_values[0].raw_value;
+        new_semantic.slot = symbol_table[semantic_values[0].raw_value];
+        break;
     }
-    else if (rule.descriptor == "plusexp") {
+    case ACT_PLUSEXP: {
         new_semantic = semantic_values[1];
+        break;
     }
-    else if (rule.descriptor == "parexp") {
+    case ACT_PAREXP: {
         new_semantic = semantic_values[1];
+        break;
     }
 
-    // for every expression type, we need to store the result in a memory location
-    else if (rule.descriptor == "id_idx") {
+    // for every expression type, we need to store the result in a virtual register
+    case ACT_ID_IDX: {
         // ID, LSQUARE, exp, RSQUARE
+        if (semantic_values[2].type == literal) {
+            // the element at a constant index is accessed like a variable
+            new_semantic.type = id;
+            new_semantic.slot = element_slot(semantic_values[0].raw_value, semantic_values[2].value);
+            break;
+        }
         // index the array
         new_semantic = semantic_values[2];
+        new_semantic.fold_operand = ir_none();
+        new_semantic.is_comparison = false;
+        new_semantic.register_need = max(new_semantic.register_need, 1);
         new_semantic.type = expression;
-        // load the exp value into $t0
-        get_semantic_value(semantic_values[2], 0, &new_semantic);
-        
-        // subtract the base address by the offset*4
-        new_semantic.push_back_instruction("sll $t0, $t0, 2");  // $t0 will hold the offset
-        // $t3 will hold the base address
-        new_semantic.push_back_instruction("addi $t3, $sp, " + to_string(symbol_table[semantic_values[0].raw_value + "[0]"]));
-        new_semantic.push_back_instruction("sub $t0, $t3, $t0");
-        // $t0 now holds the memory offset
-        new_semantic.push_back_instruction("lw $t1, 0($t0)");
-        // $t1 now holds the value of the array element
-        new_semantic.mem_location = next_mem_location;
-        next_mem_location -= 4;
-        new_semantic.push_back_instruction("sw $t1, " + to_string(new_semantic.mem_location) + "($sp)");
+        IROperand index = get_operand(semantic_values[2]);
+        int base = array_descriptor(semantic_values[0].raw_value).base;
+        new_semantic.vreg = new_vreg();
+        new_semantic.push_back_instruction(IR_LOAD_ELEM, ir_vreg(new_semantic.vreg), ir_slot(base), index);
+        break;
     }
-    else if (rule.descriptor == "not_exp") {
+    case ACT_NOT_EXP: {
         new_semantic = semantic_values[1];
-        switch (new_semantic.type)
-        {
-        case literal:
-            new_semantic.value = !new_semantic.value;
-            break;
-        case expression:
-            new_semantic.push_back_instruction("lw $t0, " + to_string(new_semantic.mem_location) + "($sp)");
-            new_semantic.push_back_instruction("sltiu $t0, $t0, 1");
-            new_semantic.push_back_instruction("andi $t0, $t0, 1");
-            new_semantic.mem_location = next_mem_location;
-            next_mem_location -= 4;
-            new_semantic.push_back_instruction("sw $t0, " + to_string(new_semantic.mem_location) + "($sp)");
-            break;
-        case id:
-            new_semantic.type = expression;
-            new_semantic.push_back_instruction("lw $t0, " + to_string(symbol_table[new_semantic.variable_name]) + "($sp)");
-            new_semantic.push_back_instruction("sltiu $t0, $t0, 1");
-            new_semantic.push_back_instruction("andi $t0, $t0, 1");
-            new_semantic.mem_location = next_mem_location;
-            next_mem_location -= 4;
-            new_semantic.push_back_instruction("sw $t0, " + to_string(new_semantic.mem_location) + "($sp)");
-            break;
-        default:
-            break;
+        if (new_semantic.type == condition) {
+            // swap the true and the false targets
+            swap(new_semantic.true_jumps, new_semantic.false_jumps);
+            new_semantic.condition_op = ir_negate_comparison(new_semantic.condition_op);
+        } else if (new_semantic.type == literal) {
+            ir_evaluate(IR_NOT, new_semantic.value, 0, &new_semantic.value);
+        } else if (new_semantic.type == expression && new_semantic.is_comparison) {
+            // the opposite comparison, e.g. !(a < b) is a >= b
+            new_semantic.instructions = new_semantic.compare_prefix;
+            push_back_result(ir_negate_comparison(new_semantic.compare_op), new_semantic.compare_lhs, new_semantic.compare_rhs, &new_semantic);
+        } else {
+            unary_operation(IR_NOT, &new_semantic);
         }
+        break;
     }
-
-    // binary operators
-    else if (rule.descriptor == "plus") {
-        new_semantic = semantic_values[0];
-        new_semantic.merge_with(semantic_values[2]);
-        new_semantic.type = expression;
-        get_semantic_value(semantic_values[0], 1, &new_semantic);
-        get_semantic_value(semantic_values[2], 2, &new_semantic);
-        new_semantic.push_back_instruction("add $t0, $t1, $t2");
-        new_semantic.mem_location = next_mem_location;
-        next_mem_location -= 4;
-        new_semantic.push_back_instruction("sw $t0, " + to_string(new_semantic.mem_location) + "($sp)");
-    }
-    else if (rule.descriptor == "minus") {
-        new_semantic = semantic_values[0];
-        new_semantic.merge_with(semantic_values[2]);
-        new_semantic.type = expression;
-        get_semantic_value(semantic_values[0], 1, &new_semantic);
-        get_semantic_value(semantic_values[2], 2, &new_semantic);
-        new_semantic.push_back_instruction("sub $t0, $t1, $t2");
-        new_semantic.mem_location = next_mem_location;
-        next_mem_location -= 4;
-        new_semantic.push_back_instruction("sw $t0, " + to_string(new_semantic.mem_location) + "($sp)");
-    }
-    else if (rule.descriptor == "mul") {
-        new_semantic = semantic_values[0];
-        new_semantic.merge_with(semantic_values[2]);
-        new_semantic.type = expression;
-        get_semantic_value(semantic_values[0], 1, &new_semantic);
-        get_semantic_value(semantic_values[2], 2, &new_semantic);
-        new_semantic.push_back_instruction("mul $t0, $t1, $t2");
-        new_semantic.mem_location = next_mem_location;
-        next_mem_location -= 4;
-        new_semantic.push_back_instruction("sw $t0, " + to_string(new_semantic.mem_location) + "($sp)");
-    }
-    else if (rule.descriptor == "div") {
-        new_semantic = semantic_values[0];
-        new_semantic.merge_with(semantic_values[2]);
-        new_semantic.type = expression;
-        get_semantic_value(semantic_values[0], 1, &new_semantic);
-        get_semantic_value(semantic_values[2], 2, &new_semantic);
-        new_semantic.push_back_instruction("div $t1, $t2");
-        new_semantic.push_back_instruction("mflo $t0");
-        new_semantic.mem_location = next_mem_location;
-        next_mem_location -= 4;
-        new_semantic.push_back_instruction("sw $t0, " + to_string(new_semantic.mem_location) + "($sp)");
-    }
-    else if (rule.descriptor == "shl") {
-        new_semantic = semantic_values[0];
-        new_semantic.merge_with(semantic_values[2]);
-        new_semantic.type = expression;
-        get_semantic_value(semantic_values[0], 1, &new_semantic);
-        get_semantic_value(semantic_values[2], 2, &new_semantic);
-        new_semantic.push_back_instruction("sllv $t0, $t1, $t2");
-        new_semantic.mem_location = next_mem_location;
-        next_mem_location -= 4;
-        new_semantic.push_back_instruction("sw $t0, " + to_string(new_semantic.mem_location) + "($sp)");
-    }
-    else if (rule.descriptor == "shr") {
-        new_semantic = semantic_values[0];
-        new_semantic.merge_with(semantic_values[2]);
-        new_semantic.type = expression;
-        get_semantic_value(semantic_values[0], 1, &new_semantic);
-        get_semantic_value(semantic_values[2], 2, &new_semantic);
-        new_semantic.push_back_instruction("srlv $t0, $t1, $t2");
-        new_semantic.mem_location = next_mem_location;
-        next_mem_location -= 4;
-        new_semantic.push_back_instruction("sw $t0, " + to_string(new_semantic.mem_location) + "($sp)");
-    }
-    else if (rule.descriptor == "and") {
-        new_semantic = semantic_values[0];
-        new_semantic.merge_with(semantic_values[2]);
-        new_semantic.type = expression;
-        get_semantic_value(semantic_values[0], 1, &new_semantic);
-        get_semantic_value(semantic_values[2], 2, &new_semantic);
-        new_semantic.push_back_instruction("and $t0, $t1, $t2");
-        new_semantic.mem_location = next_mem_location;
-        next_mem_location -= 4;
-        new_semantic.push_back_instruction("sw $t0, " + to_string(new_semantic.mem_location) + "($sp)");
-    }
-    else if (rule.descriptor == "or") {
-        new_semantic = semantic_values[0];
-        new_semantic.merge_with(semantic_values[2]);
-        new_semantic.type = expression;
-        get_semantic_value(semantic_values[0], 1, &new_semantic);
-        get_semantic_value(semantic_values[2], 2, &new_semantic);
-        new_semantic.push_back_instruction("or $t0, $t1, $t2");
-        new_semantic.mem_location = next_mem_location;
-        next_mem_location -= 4;
-        new_semantic.push_back_instruction("sw $t0, " + to_string(new_semantic.mem_location) + "($sp)");
-    }
-    else if (rule.descriptor == "andand") {
-        new_semantic = semantic_values[0];
-        new_semantic.merge_with(semantic_values[2]);
-        new_semantic.type = expression;
-        get_semantic_value(semantic_values[0], 1, &new_semantic);
-        get_semantic_value(semantic_values[2], 2, &new_semantic);
-        new_semantic.push_back_instruction("sltiu $t1, $t1, 1");
-        new_semantic.push_back_instruction("sltiu $t2, $t2, 1");
-        new_semantic.push_back_instruction("or $t0, $t1, $t2");
-        // flip bit
-        new_semantic.push_back_instruction("xori $t0, $t0, 1");
-        new_semantic.mem_location = next_mem_location;
-        next_mem_location -= 4;
-        new_semantic.push_back_instruction("sw $t0, " + to_string(new_semantic.mem_location) + "($sp)");
-        // new_semantic.push_back_instruction("add $t3, $t1, $t2");
-        // new_semantic.push_back_instruction("addi $t0, $zero, 0");
-        // // if both are 0, then 1, else 0
-        // new_semantic.push_back_instruction(string("beq $t3, 2, ") + get_next_label());
-        // new_semantic.push_back_instruction(string("b ") + get_nextnext_label());
-
-        // new_semantic.push_back_label();
-        // new_semantic.push_back_instruction("addi $t0, $zero, 1");
-        // new_semantic.push_back_label();
-
-    }
-    else if (rule.descriptor == "oror") {
-        new_semantic = semantic_values[0];
-        new_semantic.merge_with(semantic_values[2]);
-        new_semantic.type = expression;
-        get_semantic_value(semantic_values[0], 1, &new_semantic);
-        get_semantic_value(semantic_values[2], 2, &new_semantic);
-        new_semantic.push_back_instruction("or $t0, $t1, $t2");
-        new_semantic.push_back_instruction("sltiu $t0, $t0, 1");
-        // flip bit
-        new_semantic.push_back_instruction("xori $t0, $t0, 1");
-        new_semantic.mem_location = next_mem_location;
-        next_mem_location -= 4;
-        new_semantic.push_back_instruction("sw $t0, " + to_string(new_semantic.mem_location) + "($sp)");
-    }
-    else if (rule.descriptor == "eq") {
-        new_semantic = semantic_values[0];
-        new_semantic.merge_with(semantic_values[2]);
-        new_semantic.type = expression;
-        get_semantic_value(semantic_values[0], 1, &new_semantic);
-        get_semantic_value(semantic_values[2], 2, &new_semantic);
-        new_semantic.push_back_instruction("sub $t0, $t1, $t2");
-        new_semantic.push_back_instruction("sltiu $t0, $t0, 1");    // whether t0 is 0
-        new_semantic.mem_location = next_mem_location;
-        next_mem_location -= 4;
-        new_semantic.push_back_instruction("sw $t0, " + to_string(new_semantic.mem_location) + "($sp)");
-    }
-    else if (rule.descriptor == "noteq") {
-        new_semantic = semantic_values[0];
-        new_semantic.merge_with(semantic_values[2]);
-        new_semantic.type = expression;
-        get_semantic_value(semantic_values[0], 1, &new_semantic);
-        get_semantic_value(semantic_values[2], 2, &new_semantic);
-        new_semantic.push_back_instruction("sub $t0, $t1, $t2");
-        new_semantic.push_back_instruction("sltiu $t0, $t0, 1");    // whether t0 is 0
-        // flip bit
-        new_semantic.push_back_instruction("xori $t0, $t0, 1");
-        new_semantic.mem_location = next_mem_location;
-        next_mem_location -= 4;
-        new_semantic.push_back_instruction("sw $t0, " + to_string(new_semantic.mem_location) + "($sp)");
-    }
-    else if (rule.descriptor == "lt") {
-        new_semantic = semantic_values[0];
-        new_semantic.merge_with(semantic_values[2]);
-        new_semantic.type = expression;
-        get_semantic_value(semantic_values[0], 1, &new_semantic);
-        get_semantic_value(semantic_values[2], 2, &new_semantic);
-        new_semantic.push_back_instruction("slt $t0, $t1, $t2");
-        new_semantic.mem_location = next_mem_location;
-        next_mem_location -= 4;
-        new_semantic.push_back_instruction("sw $t0, " + to_string(new_semantic.mem_location) + "($sp)");
-    }
-    else if (rule.descriptor == "gt") {
-        new_semantic = semantic_values[0];
-        new_semantic.merge_with(semantic_values[2]);
-        new_semantic.type = expression;
-        get_semantic_value(semantic_values[0], 1, &new_semantic);
-        get_semantic_value(semantic_values[2], 2, &new_semantic);
-        new_semantic.push_back_instruction("slt $t0, $t2, $t1");
-        new_semantic.mem_location = next_mem_location;
-        next_mem_location -= 4;
-        new_semantic.push_back_instruction("sw $t0, " + to_string(new_semantic.mem_location) + "($sp)");
-    }
-    else if (rule.descriptor == "lteq") {
-        new_semantic = semantic_values[0];
-        new_semantic.merge_with(semantic_values[2]);
-        new_semantic.type = expression;
-        get_semantic_value(semantic_values[0], 1, &new_semantic);
-        get_semantic_value(semantic_values[2], 2, &new_semantic);
-        new_semantic.push_back_instruction("addi $t2, $t2, 1");
-        new_semantic.push_back_instruction("slt $t0, $t1, $t2");
-        new_semantic.mem_location = next_mem_location;
-        next_mem_location -= 4;
-        new_semantic.push_back_instruction("sw $t0, " + to_string(new_semantic.mem_location) + "($sp)");
-    }
-    else if (rule.descriptor == "gteq") {
-        new_semantic = semantic_values[0];
-        new_semantic.merge_with(semantic_values[2]);
-        new_semantic.type = expression;
-        get_semantic_value(semantic_values[0], 1, &new_semantic);
-        get_semantic_value(semantic_values[2], 2, &new_semantic);
-        new_semantic.push_back_instruction("addi $t1, $t1, 1");
-        new_semantic.push_back_instruction("slt $t0, $t2, $t1");
-        new_semantic.mem_location = next_mem_location;
-        next_mem_location -= 4;
-        new_semantic.push_back_instruction("sw $t0, " + to_string(new_semantic.mem_location) + "($sp)");
-    }
-    else if (rule.descriptor == "minusexp") {
+    case ACT_MINUSEXP: {
         new_semantic = semantic_values[1];
-        switch (new_semantic.type)
-        {
-        case literal:
-            new_semantic.value = -new_semantic.value;
-            break;
-        case expression:
-            new_semantic.push_back_instruction("lw $t0, " + to_string(new_semantic.mem_location) + "($sp)");
-            new_semantic.push_back_instruction("sub $t0, $zero, $t0");
-            new_semantic.mem_location = next_mem_location;
-            next_mem_location -= 4;
-            new_semantic.push_back_instruction("sw $t0, " + to_string(new_semantic.mem_location) + "($sp)");
-            break;
-        case id:
-            new_semantic.type = expression;
-            new_semantic.push_back_instruction("lw $t0, " + to_string(symbol_table[new_semantic.variable_name]) + "($sp)");
-            new_semantic.push_back_instruction("sub $t0, $zero, $t0");
-            new_semantic.mem_location = next_mem_location;
-            next_mem_location -= 4;
-            new_semantic.push_back_instruction("sw $t0, " + to_string(new_semantic.mem_location) + "($sp)");
-            break;
-        default:
-            break;
+        if (new_semantic.type == literal) {
+            ir_evaluate(IR_NEG, new_semantic.value, 0, &new_semantic.value);
+        } else {
+            unary_operation(IR_NEG, &new_semantic);
         }
+        break;
     }
-    else if (rule.descriptor == "scope_begin") {
+
+    // binary operators
+    case ACT_PLUS: binary_operation(IR_ADD, semantic_values, &new_semantic); break;
+    case ACT_MINUS: binary_operation(IR_SUB, semantic_values, &new_semantic); break;
+    case ACT_MUL: binary_operation(IR_MUL, semantic_values, &new_semantic); break;
+    case ACT_DIV: binary_operation(IR_DIV, semantic_values, &new_semantic); break;
+    case ACT_SHL: binary_operation(IR_SHL, semantic_values, &new_semantic); break;
+    case ACT_SHR: binary_operation(IR_SHR, semantic_values, &new_semantic); break;
+    case ACT_AND: binary_operation(IR_AND, semantic_values, &new_semantic); break;
+    case ACT_OR: binary_operation(IR_OR, semantic_values, &new_semantic); break;
+    case ACT_ANDAND: logical_operation(true, semantic_values, &new_semantic); break;
+    case ACT_OROR: logical_operation(false, semantic_values, &new_semantic); break;
+    case ACT_EQ: binary_operation(IR_EQ, semantic_values, &new_semantic); break;
+    case ACT_NOTEQ: binary_operation(IR_NE, semantic_values, &new_semantic); break;
+    case ACT_LT: binary_operation(IR_LT, semantic_values, &new_semantic); break;
+    case ACT_GT: binary_operation(IR_GT, semantic_values, &new_semantic); break;
+    case ACT_LTEQ: binary_operation(IR_LE, semantic_values, &new_semantic); break;
+    case ACT_GTEQ: binary_operation(IR_GE, semantic_values, &new_semantic); break;
+
+    case ACT_SCOPE_BEGIN: {
         symbol_table.add_scope();
+        break;
     }
-    else if (rule.descriptor == "scope_end") {
+    case ACT_SCOPE_END: {
         symbol_table.close_scope();
+        break;
     }
-    else if (rule.descriptor == "write") {
+    case ACT_WRITE: {
         new_semantic = semantic_values[2];
-        // prepare the rvalue in $t0
-        get_semantic_value(semantic_values[2], 0, &new_semantic);
-        
-        // load the value into $a0
         new_semantic.type = stmt;
-        new_semantic.push_back_instruction("add $a0, $zero, $t0");
-        // load 1 in $v0 and print the integer
-        new_semantic.push_back_instruction("addi $v0, $zero, 1");
-        new_semantic.push_back_instruction("syscall");
-        // print newline character
-        new_semantic.push_back_instruction("addi $v0, $zero, 11");
-        new_semantic.push_back_instruction("addi $a0, $zero, 10");
-        new_semantic.push_back_instruction("syscall");
-    }
-    else if (rule.descriptor == "read") {
-        // load 5 in $v0
-        new_semantic.push_back_instruction("addi $v0, $zero, 5");
-        new_semantic.push_back_instruction("syscall");
-        // store the result in $v0 to the variable
+        new_semantic.push_back_instruction(IR_WRITE, ir_none(), get_operand(semantic_values[2]));
+        break;
+    }
+    case ACT_READ: {
         new_semantic.type = stmt;
-        new_semantic.push_back_instruction("sw $v0, " + to_string(symbol_table[semantic_values[2].raw_value]) + "($sp)");
+        new_semantic.push_back_instruction(IR_READ, ir_slot(symbol_table[semantic_values[2].raw_value]));
+        break;
     }
-    else if (rule.descriptor == "return") {
+    case ACT_RETURN: {
         new_semantic.type = stmt;
-        new_semantic.push_back_instruction("b end");
+        new_semantic.push_back_instruction(IR_RETURN, ir_none());
+        break;
     }
-    else if (rule.descriptor == "program1") {
+    case ACT_PROGRAM1: {
         new_semantic = semantic_values[0];
-        // insert main label at the front
-        new_semantic.instructions.insert(new_semantic.instructions.begin(), "main:");
         new_semantic.merge_with(semantic_values[1]);
-        new_semantic.instructions.push_back("end:");
-        new_semantic.push_back_instruction("addi $v0, $zero, 1");   // a placeholder instruction
-        // print out all instructions
-        for (auto instruction : new_semantic.instructions) {
-            cout << instruction << endl;
-        }
+        finish_program(new_semantic);
+        break;
     }
-    else if (rule.descriptor == "program2") {
+    case ACT_PROGRAM2: {
         new_semantic = semantic_values[0];
-        // insert main label at the front
-        new_semantic.instructions.insert(new_semantic.instructions.begin(), "main:");
-        new_semantic.instructions.push_back("end:");
-        new_semantic.push_back_instruction("addi $v0, $zero, 1");   // a placeholder instruction
-        // print out all instructions
-        for (auto instruction : new_semantic.instructions) {
-            cout << instruction << endl;
-        }
+        finish_program(new_semantic);
+        break;
     }
-    else if (rule.descriptor == "code_block") {
+    case ACT_CODE_BLOCK: {
         new_semantic = semantic_values[1];
+        break;
     }
-    else if (rule.descriptor == "assign_statement") {
+    case ACT_ASSIGN_STATEMENT: {
         new_semantic = semantic_values[0];
+        break;
     }
-    else if (rule.descriptor == "read_write_statement") {
+    case ACT_READ_WRITE_STATEMENT: {
         new_semantic = semantic_values[0];
+        break;
     }
-    else if (rule.descriptor == "do_while_statement" || rule.descriptor == "return_statement") {
+    case ACT_DO_WHILE_STATEMENT:
+    case ACT_RETURN_STATEMENT: {
         new_semantic = semantic_values[0];
+        break;
     }
-    else if (rule.descriptor == "assign2") {
+    case ACT_ASSIGN2: {
         // ID, ASSIGN, exp
         new_semantic = semantic_values[2];
         new_semantic.type = stmt;
-        get_semantic_value(semantic_values[2], 0, &new_semantic);
-        new_semantic.push_back_instruction("sw $t0, " + to_string(symbol_table[semantic_values[0].raw_value]) + "($sp)");
+        IROperand value = get_operand(semantic_values[2]);
+        new_semantic.push_back_instruction(IR_MOV, ir_slot(symbol_table[semantic_values[0].raw_value]), value);
+        break;
     }
-    else if (rule.descriptor == "assign1") {
+    case ACT_ASSIGN1: {
         // ID, LSQUARE, exp, RSQUARE, ASSIGN, exp
-        new_semantic = semantic_values[5];
-        new_semantic.type = stmt;
-        // prepare the rvalue in $t0
-        get_semantic_value(semantic_values[5], 0, &new_semantic);
-        // calculate the lvalue address in $t1
-        get_semantic_value(semantic_values[2], 1, &new_semantic);
-        // subtract the base address by the offset*4
-        new_semantic.push_back_instruction("sll $t1, $t1, 2");
-        // $t3 will hold the base address
-        new_semantic.push_back_instruction("addi $t3, $sp, " + to_string(symbol_table[semantic_values[0].raw_value + "[0]"]));
-        new_semantic.push_back_instruction("sub $t1, $t3, $t1");
-        // store the value in $t0 to the address in $t1
-        new_semantic.push_back_instruction("sw $t0, 0($t1)");
-    }
-    else if (rule.descriptor == "if") {
+        // the index is computed first, then the value
         new_semantic = semantic_values[2];
-        // load the exp value into $t0
-        get_semantic_value(semantic_values[2], 0, &new_semantic);
-        new_semantic.push_back_instruction("beq $t0, $zero, " + get_nextnext_label());
-        new_semantic.push_back_instruction("b " + get_next_label());
-
-        new_semantic.push_back_label();
+        new_semantic.merge_with(semantic_values[5]);
+        new_semantic.type = stmt;
+        IROperand value = get_operand(semantic_values[5]);
+        if (semantic_values[2].type == literal) {
+            // the element at a constant index is assigned like a variable
+            int element = element_slot(semantic_values[0].raw_value, semantic_values[2].value);
+            new_semantic.push_back_instruction(IR_MOV, ir_slot(element), value);
+            break;
+        }
+        IROperand index = get_operand(semantic_values[2]);
+        int base = array_descriptor(semantic_values[0].raw_value).base;
+        new_semantic.push_back_instruction(IR_STORE_ELEM, ir_slot(base), index, value);
+        break;
+    }
+    case ACT_IF: {
+        // IF, LPAR, exp, RPAR, code_block
+        int end_label = new_label();
+        // if false, skip the then part
+        jump_on_condition(semantic_values[2], false, end_label, &new_semantic);
         new_semantic.merge_with(semantic_values[4]);
-        new_semantic.push_back_label();
-
+        new_semantic.else_jump = new_semantic.instructions.reserve();
+        new_semantic.push_back_label(end_label);
+        break;
     }
-    else if (rule.descriptor == "if_else") {
+    case ACT_IF_ELSE: {
+        // if_stmt, ELSE, code_block
+        int end_label = new_label();
         new_semantic = semantic_values[0];
-        new_semantic.instructions.insert(new_semantic.instructions.end()-1, "b " + get_next_label());
+        InstructionList::insert_at(new_semantic.else_jump, IRInst{IR_JUMP, ir_none(), ir_label(end_label), ir_none()});
         new_semantic.merge_with(semantic_values[2]);
-        new_semantic.push_back_label();
+        new_semantic.push_back_label(end_label);
+        break;
     }
-    else if (rule.descriptor == "while") {
+    case ACT_WHILE: {
         // WHILE, LPAR, exp, RPAR, code_block
-        string start_label = get_next_label();
-        new_semantic.push_back_label();
-        new_semantic.merge_with(semantic_values[2]);
-
-        // load the exp value into $t0
-        get_semantic_value(semantic_values[2], 0, &new_semantic);
-        new_semantic.push_back_instruction("beq $t0, $zero, " + get_next_label());  // if false, jump to the end of the loop
-        new_semantic.merge_with(semantic_values[4]);
-        new_semantic.push_back_instruction("b " + start_label);
-        new_semantic.push_back_label();
+        int start_label = new_label();
+        int end_label = new_label();
+        lower_while(semantic_values[2], semantic_values[4], start_label, end_label, &new_semantic);
+        break;
     }
-    else if (rule.descriptor == "do_while") {
+    case ACT_DO_WHILE: {
         // DO, code_block, WHILE, LPAR, exp, RPAR
-        string start_label = get_next_label();
-        new_semantic.push_back_label();
-        new_semantic.merge_with(semantic_values[1]);
-        new_semantic.merge_with(semantic_values[4]);
-
-        // load the exp value into $t0
-        get_semantic_value(semantic_values[4], 0, &new_semantic);
-        
-        new_semantic.push_back_instruction("beq $t0, $zero, " + get_next_label());  // if false, jump to the end of the loop
-        new_semantic.push_back_instruction("b " + start_label);
-        new_semantic.push_back_label();
+        int start_label = new_label();
+        int end_label = new_label();
+        lower_do_while(semantic_values[1], semantic_values[4], start_label, end_label, &new_semantic);
+        break;
     }
-    else if (rule.descriptor == "decl_list") {
+    case ACT_DECL_LIST: {
         new_semantic = semantic_values[0];
         new_semantic.merge_with(semantic_values[2]);
+        break;
     }
-    else if (rule.descriptor == "var_decl") {
+    case ACT_VAR_DECL: {
         new_semantic = semantic_values[1];
+        break;
     }
 
-
-    else {
+    // rules without a routine
+    case ACT_AUTO_COPY:
+    default: {
         if (semantic_values.size() == 1) {
             new_semantic = semantic_values[0];
         }
@@ -541,7 +851,123 @@ void codegen(ProductionRule rule, std::stack<Semantic> *semantic_stack) {
         else {
             assert(false);
         }
+        break;
+    }
+    }
+
+    semantic_stack->push(std::move(new_semantic));
+}
+
+// AST mode: the reductions only build the tree, and the code generation pass walks it afterwards
+
+static Ast ast;
+
+static Semantic generate(uint32_t node_id);
+
+// the code of a left-recursive list (`statements` or `var_declarations`), by walking down its left spine
+static Semantic generate_list(uint32_t node_id) {
+    vector<uint32_t> items;
+    while (!ast.nodes[node_id].is_terminal && ast.nodes[node_id].action == ACT_AUTO_COPY && ast.nodes[node_id].child_count == 2) {
+        items.push_back(ast.child(node_id, 1));
+        node_id = ast.child(node_id, 0);
+    }
+    items.push_back(node_id);
+    Semantic new_semantic = generate(items.back());
+    for (int i = items.size() - 2; i >= 0; i--) {
+        new_semantic.merge_with(generate(items[i]));
+    }
+    return new_semantic;
+}
+
+// the code of an if statement with an optional else part, labels are allocated before the children
+static Semantic generate_if(uint32_t if_node, int else_part) {
+    // IF, LPAR, exp, RPAR, code_block
+    int else_label = else_part >= 0 ? new_label() : -1;
+    int end_label = new_label();
+    Semantic new_semantic;
+    // if false, skip the then part
+    jump_on_condition(generate(ast.child(if_node, 2)), false, else_part >= 0 ? else_label : end_label, &new_semantic);
+    new_semantic.merge_with(generate(ast.child(if_node, 4)));
+    if (else_part >= 0) {
+        new_semantic.push_back_instruction(IR_JUMP, ir_none(), ir_label(end_label));
+        new_semantic.push_back_label(else_label);
+        new_semantic.merge_with(generate(else_part));
+    }
+    new_semantic.push_back_label(end_label);
+    new_semantic.type = stmt;
+    return new_semantic;
+}
+
+static Semantic generate(uint32_t node_id) {
+    const AstNode& node = ast.nodes[node_id];
+    if (node.is_terminal) {
+        return Semantic(ast.texts[node.text]);
+    }
+    switch (node.action)
+    {
+    case ACT_IF: {
+        return generate_if(node_id, -1);
+    }
+    case ACT_IF_ELSE: {
+        // if_stmt, ELSE, code_block
+        return generate_if(ast.child(node_id, 0), ast.child(node_id, 2));
+    }
+    case ACT_WHILE: {
+        // WHILE, LPAR, exp, RPAR, code_block
+        int start_label = new_label();
+        int end_label = new_label();
+        Semantic condition = generate(ast.child(node_id, 2));
+        Semantic body = generate(ast.child(node_id, 4));
+        Semantic new_semantic;
+        lower_while(condition, body, start_label, end_label, &new_semantic);
+        return new_semantic;
+    }
+    case ACT_DO_WHILE: {
+        // DO, code_block, WHILE, LPAR, exp, RPAR
+        int start_label = new_label();
+        int end_label = new_label();
+        Semantic body = generate(ast.child(node_id, 1));
+        Semantic new_semantic;
+        lower_do_while(body, generate(ast.child(node_id, 4)), start_label, end_label, &new_semantic);
+        return new_semantic;
+    }
+    case ACT_AUTO_COPY: {
+        if (node.child_count == 2) {
+            return generate_list(node_id);
+        }
+        [[fallthrough]];
+    }
+    default: {
+        // other routines only depend on the code of their children, run them as upon reduction
+        stack<Semantic> semantic_stack;
+        for (uint32_t i = 0; i < node.child_count; i++) {
+            semantic_stack.push(generate(ast.child(node_id, i)));
+        }
+        codegen(node.action, node.child_count, &semantic_stack);
+        return semantic_stack.top();
+    }
+    }
+}
+
+void build_ast(semantic_action action, int rhs_size, std::stack<Semantic> *semantic_stack) {
+    vector<uint32_t> child_nodes(rhs_size);
+    for (int i = rhs_size - 1; i >= 0; i--) {
+        const Semantic& child = semantic_stack->top();
+        child_nodes[i] = child.ast_node >= 0 ? child.ast_node : ast.add_terminal(child.raw_value);
+        semantic_stack->pop();
     }
-    
-    semantic_stack->push(new_semantic);
-}
\ No newline at end of file
+
+    Semantic new_semantic;
+    if (action == ACT_AUTO_COPY && rhs_size == 1) {
+        // a single child is passed up without a node of its own
+        new_semantic.ast_node = child_nodes[0];
+    } else {
+        new_semantic.ast_node = ast.add_node(action, child_nodes);
+    }
+
+    if (action == ACT_PROGRAM1 || action == ACT_PROGRAM2) {
+        // the whole tree is built, run the code generation pass
+        generate(new_semantic.ast_node);
+    }
+    semantic_stack->push(std::move(new_semantic));
+}
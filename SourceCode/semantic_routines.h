@@ -6,8 +6,11 @@
     The `semantic_type` is used to determine the type of `Semantic` object and guide to the corresponding data field.
     The `SymbolTable` is used to store the symbol table for the compiler with scoping information.
     The `Semantic` is used to store the semantic information for each scanned token.
+    The `InstructionList` is used to store the generated instructions of a `Semantic` as a rope.
 
     `codegen` is the main function for code generation, which is called by the parser whenever a production rule is reduced.
+    It lowers the code into IR instructions; the whole program is printed by the MIPS emitter when it is reduced.
+    `build_ast` is used instead in AST mode.
 */
 
 #pragma once
@@ -20,12 +23,14 @@
 #include <map>
 
 #include "parser.h"
+#include "ir.h"
 
 // This enum is used to determine the type of a primary struct and guide to the corresponding data field
 enum semantic_type {
     id, // id value is stored in a memory location
     literal,
     expression,
+    condition,  // a logical expression lowered to jumps, see `Semantic::true_jumps`
 
     terminal,   // the raw info directly from scanner
 
@@ -34,33 +39,112 @@ enum semantic_type {
 
 extern int next_mem_location;
 
+extern bool show_stats;     // print the statistics of the optimizations to stderr
+extern std::string output_fname;   // the file the assembly is written to, stdout if empty
+
+// the descriptor of an array, a single symbol for all of its elements
+struct ArrayDescriptor {
+    int base;           // the slot of the first element
+    int length;
+    int element_size;   // the elements are laid out downwards from the base
+};
+
+// the scoped symbol table, mapping a name to the stack slot of the innermost declaration of it
+// the names are interned into a flat open-addressing hash table, each holding its current slot, and the
+// declarations of a scope are undone from a log when it is closed
 class SymbolTable {
 public:
-    SymbolTable() {
-        // initialize the global scope
-        tables.push_back(std::map<std::string, int>());
-    }
-    std::vector<std::map<std::string, int>> tables;
-    int operator[](std::string key) {
-        for (int i = tables.size() - 1; i >= 0; i--) {
-            if (tables[i].find(key) != tables[i].end()) {
-                return tables[i][key];
-            }
-        }
-        add_symbol(key, next_mem_location);
-        next_mem_location -= 4;
-        return operator[](key);
+    SymbolTable() : buckets(initial_buckets, -1) {}
+
+    // the slot of a name, which is declared in the innermost scope if it is not declared yet
+    int operator[](const std::string& key);
+    bool contains(const std::string& key) const {
+        int symbol = find(key);
+        return symbol >= 0 && symbols[symbol].slot != undeclared;
     }
     void add_scope() {
-        tables.push_back(std::map<std::string, int>());
+        scope_marks.push_back(undo_log.size());
     }
-    void close_scope() {
-        tables.pop_back();
+    void close_scope();
+    void add_symbol(const std::string& key, int loc);
+    void add_array(const std::string& key, const ArrayDescriptor& descriptor);
+    // the descriptor of the array declared with a name, or nullptr if it is not an array
+    const ArrayDescriptor* array(const std::string& key) const;
+
+private:
+    static const int initial_buckets = 256;     // a power of two
+    static const int undeclared = 1;    // slots are negative
+
+    struct Symbol {
+        std::string name;
+        size_t hash;
+        int slot;   // the slot of the innermost declaration, or `undeclared`
+        int array;  // the descriptor of the innermost declaration, -1 if it is not an array
+    };
+    struct Binding {
+        int symbol;
+        int slot;
+        int array;
+    };
+    std::vector<Symbol> symbols;    // the interned names
+    std::vector<int> buckets;       // the symbol of each bucket, -1 if empty, probed linearly
+    std::vector<ArrayDescriptor> descriptors;
+    std::vector<Binding> undo_log;  // the symbols declared, with the binding each one had before
+    std::vector<size_t> scope_marks;    // the length of the undo log when each open scope began
+
+    // the symbol of a name, or -1 if it was never seen
+    int find(const std::string& key) const;
+    int intern(const std::string& key);
+    void bind(int symbol, int slot, int array);
+};
+// a node of the instruction rope, allocated from the rope arena
+struct RopeNode {
+    enum kind_t {
+        LEAF,   // a single instruction
+        CONCAT, // the instructions of `left` followed by those of `right`
+        HOLE,   // a stable position, whose content `left` can be filled in later
+    } kind;
+    IRInst instruction;     // only leaf has this
+    RopeNode* left;
+    RopeNode* right;
+};
+
+// the generated instructions, stored as a rope of arena-allocated nodes
+// nodes are never modified once linked (except filling a hole), so copying, merging and
+// prepending are O(1) and share the nodes instead of copying the instructions
+class InstructionList {
+public:
+    typedef RopeNode* Position;
+
+    void push_back(const IRInst& instruction);
+    void push_front(const IRInst& instruction);
+    void append(const InstructionList& other);
+    void prepend(const InstructionList& other);
+
+    // append an empty position, whose instructions can be inserted later by `insert_at`
+    Position reserve();
+    static void insert_at(Position position, const IRInst& instruction);
+
+    bool empty() const {
+        return root == nullptr;
     }
-    void add_symbol(std::string key, int loc) {
-        tables[tables.size() - 1][key] = loc;
+    void clear() {
+        root = nullptr;
     }
+
+    // collect the instructions in order
+    void flatten(std::vector<IRInst>* out) const;
+
+private:
+    RopeNode* root = nullptr;
+};
+
+// a jump whose target label is not known yet, filled in by backpatching
+struct PendingJump {
+    InstructionList::Position position;
+    IRInst instruction;     // the jump or branch, without its label
 };
+
 class Semantic {
 public:
     Semantic(std::string terminal_value) {
@@ -71,43 +155,70 @@ public:
         type = terminal;
         raw_value = "";
         value = 0;
-        mem_location = 0;
+        vreg = 0;
     }
     // if is literal, then retrieve value from it
-    // if is expression, then retrieve from the memory location {mem_location}($sp)
+    // if is expression, then retrieve from the virtual register {vreg}
     // if is variable, then retrieve value from looking up symbol table
     enum semantic_type type;
-    std::string variable_name;    // only variable has this
+    int slot;   // only variable has this, the stack slot its name is resolved to when the `Semantic` is created
     int value;  // only int literal has this
 
     std::string raw_value;
 
-    int mem_location;  // used to store expression
+    int vreg;  // used to store expression
+    // only expression computed as `fold_operand fold_op constant` has these, used to reassociate constant chains
+    // `fold_prefix` is the code before that last instruction
+    IROperand fold_operand = ir_none();
+    ir_opcode fold_op;
+    int fold_constant;
+    InstructionList fold_prefix;
 
-    std::vector<std::string> instructions;
+    // only expression computed by a comparison has these, so that a condition branches on the comparison itself
+    // `compare_prefix` is the code before the comparison
+    bool is_comparison = false;
+    ir_opcode compare_op;
+    IROperand compare_lhs;
+    IROperand compare_rhs;
+    InstructionList compare_prefix;
 
-    void push_back_instruction(std::string instruction) {
-        instructions.push_back(std::string("\t") + instruction);
-    }
+    int register_need = 0;  // the number of registers to evaluate the expression (Ershov number), 0 for literal and variable
 
-    // return the label number
-    int push_back_label();
+    int ast_node = -1;  // only in AST mode, the node of the syntax tree, -1 for a shifted terminal
 
-    void printout() {
-        for (std::string instruction : instructions) {
-            std::cout << instruction << std::endl;
-        }
-        instructions.clear();
+    InstructionList instructions;
+
+    InstructionList::Position else_jump = nullptr;  // only if statement has this, where the jump over the else part goes
+
+    // only condition has these: after its instructions, it is true if `condition_lhs condition_op condition_rhs`,
+    // and the jumps taken before go to the true or the false target
+    ir_opcode condition_op;
+    IROperand condition_lhs = ir_none();
+    IROperand condition_rhs = ir_none();
+    std::vector<PendingJump> true_jumps;
+    std::vector<PendingJump> false_jumps;
+
+    void push_back_instruction(ir_opcode op, IROperand dst, IROperand a = ir_none(), IROperand b = ir_none()) {
+        instructions.push_back(IRInst{op, dst, a, b});
     }
 
-    void merge_with(Semantic other) {
-        instructions.insert(instructions.end(), other.instructions.begin(), other.instructions.end());
+    void push_back_label(int label) {
+        push_back_instruction(IR_LABEL, ir_none(), ir_label(label));
+    }
+
+    void merge_with(const Semantic& other) {
+        instructions.append(other.instructions);
     }
 
     // std::vector<std::string> evaluate_expression();  // evaluation result saved in $t0
 };
 
-void codegen(ProductionRule rule, std::stack<Semantic> *semantic_stack);
+// run the semantic routine of a reduced production rule, whose right-hand side has `rhs_size` symbols
+void codegen(semantic_action action, int rhs_size, std::stack<Semantic> *semantic_stack);
+
+// AST mode: build the syntax tree node of a reduced production rule instead,
+// the code is generated by a separate pass once the whole program is reduced
+void build_ast(semantic_action action, int rhs_size, std::stack<Semantic> *semantic_stack);
 
 
 
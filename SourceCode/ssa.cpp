@@ -0,0 +1,224 @@
+/*
+    File: ssa.cpp
+    Author: Jiaqi Li
+    The static single assignment (SSA) form of the IR program
+*/
+
+#include "ssa.h"
+
+using namespace std;
+
+SSAForm::SSAForm(const IRProgram& program, const ControlFlowGraph& cfg) : program(program), cfg(cfg) {
+    // the arrays accessed by address are in memory
+    memory_array.assign(program.arrays.size(), false);
+    for (const IRInst& inst : program.code) {
+        const IROperand* array = &inst.a;
+        if (!ir_is_array_operand(inst, array)) {
+            array = &inst.dst;
+        }
+        if (ir_is_array_operand(inst, array)) {
+            memory_array[program.array_of(array->value) - &program.arrays[0]] = true;
+        }
+    }
+
+    // the virtual registers, then the scalar slots
+    int variables = program.vreg_home.size();
+    for (const IRInst& inst : program.code) {
+        for (const IROperand* opd : {&inst.dst, &inst.a, &inst.b}) {
+            if (opd->kind == OPD_SLOT && !ir_is_array_operand(inst, opd) && !in_memory(opd->value)
+                && slot_variable.count(opd->value) == 0) {
+                slot_variable[opd->value] = variables++;
+                variable_slot.push_back(opd->value);
+            }
+        }
+    }
+    // the value of each variable at the start of the program has the number of the variable
+    for (int v = 0; v < variables; v++) {
+        values.push_back(SSAValue{v, -1, -1});
+        current.push_back(v);
+    }
+
+    defined_value.assign(program.code.size(), -1);
+    used_values.assign(program.code.size(), {-1, -1});
+    phis.assign(cfg.blocks.size(), {});
+    if (!cfg.blocks.empty()) {
+        place_phis();
+        walk([this](int block) { name_values(block); });
+    }
+}
+
+int SSAForm::variable_of(IROperand opd) const {
+    if (opd.kind == OPD_VREG) {
+        return opd.value;
+    }
+    if (opd.kind == OPD_SLOT) {
+        map<int, int>::const_iterator it = slot_variable.find(opd.value);
+        return it == slot_variable.end() ? -1 : it->second;
+    }
+    return -1;
+}
+
+IROperand SSAForm::operand_of(int variable) const {
+    int vregs = program.vreg_home.size();
+    return variable < vregs ? ir_vreg(variable) : ir_slot(variable_slot[variable - vregs]);
+}
+
+bool SSAForm::in_memory(int slot) const {
+    const pair<int, int>* array = program.array_of(slot);
+    return array != nullptr && memory_array[array - &program.arrays[0]];
+}
+
+void SSAForm::set_current(int variable, int value) {
+    undo.push_back({variable, current[variable]});
+    current[variable] = value;
+}
+
+void SSAForm::enter(int block) {
+    undo_marks.push_back(undo.size());
+    for (const PhiFunction& phi : phis[block]) {
+        set_current(phi.variable, phi.value);
+    }
+}
+
+void SSAForm::step(int instruction) {
+    if (defined_value[instruction] >= 0) {
+        set_current(values[defined_value[instruction]].variable, defined_value[instruction]);
+    }
+}
+
+void SSAForm::leave() {
+    while ((int)undo.size() > undo_marks.back()) {
+        current[undo.back().first] = undo.back().second;
+        undo.pop_back();
+    }
+    undo_marks.pop_back();
+}
+
+void SSAForm::walk(const function<void(int)>& visit, const function<void(int)>& finish) {
+    vector<pair<int, int>> pending = {{0, 0}};  // the block, and its next child to walk
+    enter(0);
+    visit(0);
+    while (!pending.empty()) {
+        int block = pending.back().first;
+        int next = pending.back().second;
+        if (next < (int)cfg.dominated[block].size()) {
+            int child = cfg.dominated[block][next];
+            pending.back().second++;
+            pending.push_back({child, 0});
+            enter(child);
+            visit(child);
+            continue;
+        }
+        if (finish) {
+            finish(block);
+        }
+        leave();
+        pending.pop_back();
+    }
+}
+
+void SSAForm::place_phis() {
+    int blocks = cfg.blocks.size();
+    vector<bool> reachable(blocks, false);
+    for (int b : cfg.reverse_postorder) {
+        reachable[b] = true;
+    }
+
+    // the dominance frontiers
+    vector<vector<int>> frontier(blocks);
+    for (int b : cfg.reverse_postorder) {
+        // the first block is also entered at the start of the program
+        if (cfg.blocks[b].predecessors.size() + (b == 0) < 2) {
+            continue;
+        }
+        for (int predecessor : cfg.blocks[b].predecessors) {
+            for (int runner = predecessor; reachable[runner] && runner != cfg.immediate_dominator[b];
+                 runner = cfg.immediate_dominator[runner]) {
+                if (frontier[runner].empty() || frontier[runner].back() != b) {
+                    frontier[runner].push_back(b);
+                }
+                if (runner == 0) {
+                    break;
+                }
+            }
+        }
+    }
+
+    // the variables read before they are defined in some block, and the blocks defining each variable
+    vector<bool> global(current.size(), false);
+    vector<vector<int>> defining_blocks(current.size());
+    vector<int> defined_in(current.size(), -1);     // the last block each variable is defined in so far
+    for (int b : cfg.reverse_postorder) {
+        for (int i = cfg.blocks[b].start; i < cfg.blocks[b].end; i++) {
+            const IRInst& inst = program.code[i];
+            for (const IROperand& opd : {inst.a, inst.b}) {
+                int variable = variable_of(opd);
+                if (variable >= 0 && ir_reads(inst, opd) && defined_in[variable] != b) {
+                    global[variable] = true;
+                }
+            }
+            int variable = ir_defines(inst.op) ? variable_of(inst.dst) : -1;
+            if (variable >= 0) {
+                if (defined_in[variable] != b) {
+                    defined_in[variable] = b;
+                    defining_blocks[variable].push_back(b);
+                }
+            }
+        }
+    }
+
+    // the iterated dominance frontiers
+    vector<int> has_phi(blocks, -1);    // the last variable given a phi function in each block
+    for (int variable = 0; variable < (int)global.size(); variable++) {
+        if (!global[variable]) {
+            continue;
+        }
+        vector<int> pending = defining_blocks[variable];
+        while (!pending.empty()) {
+            int b = pending.back();
+            pending.pop_back();
+            for (int join : frontier[b]) {
+                if (has_phi[join] == variable) {
+                    continue;
+                }
+                has_phi[join] = variable;
+                values.push_back(SSAValue{variable, -1, join});
+                PhiFunction phi{variable, (int)values.size() - 1, vector<int>(cfg.blocks[join].predecessors.size(), -1)};
+                if (join == 0) {
+                    // the first block is also entered at the start of the program
+                    phi.operands.push_back(variable);
+                }
+                phis[join].push_back(phi);
+                pending.push_back(join);
+            }
+        }
+    }
+}
+
+void SSAForm::name_values(int block) {
+    for (int i = cfg.blocks[block].start; i < cfg.blocks[block].end; i++) {
+        const IRInst& inst = program.code[i];
+        if (ir_reads(inst, inst.a) && variable_of(inst.a) >= 0) {
+            used_values[i][0] = current[variable_of(inst.a)];
+        }
+        if (variable_of(inst.b) >= 0) {
+            used_values[i][1] = current[variable_of(inst.b)];
+        }
+        int variable = ir_defines(inst.op) ? variable_of(inst.dst) : -1;
+        if (variable >= 0) {
+            values.push_back(SSAValue{variable, i, block});
+            defined_value[i] = values.size() - 1;
+        }
+        step(i);
+    }
+    for (int successor : cfg.blocks[block].successors) {
+        const vector<int>& predecessors = cfg.blocks[successor].predecessors;
+        for (PhiFunction& phi : phis[successor]) {
+            for (int j = 0; j < (int)predecessors.size(); j++) {
+                if (predecessors[j] == block) {
+                    phi.operands[j] = current[phi.variable];
+                }
+            }
+        }
+    }
+}
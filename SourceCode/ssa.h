@@ -0,0 +1,79 @@
+/*
+    File: ssa.h
+    Author: Jiaqi Li
+    The static single assignment (SSA) form of the IR program, for the global optimizations.
+
+    The variables are the virtual registers and the scalar variables in the stack. The elements of an array indexed
+    by a variable (or a pointer) may be changed through any store to the array, so they are memory, not variables.
+    Every definition of a variable, and every phi function at a join point, is a value of its own. The code is not
+    rewritten: each instruction only records the values it reads and defines, so the optimizations change the code
+    in place and the emitter keeps its variables and virtual registers.
+
+    The phi functions are placed at the iterated dominance frontiers of the definitions (Cytron et al.), only for the
+    variables read in a block other than where they are defined, and the values are named by a walk over the
+    dominator tree.
+*/
+
+#pragma once
+
+#include <vector>
+#include <map>
+#include <functional>
+
+#include "ir.h"
+#include "cfg.h"
+
+struct PhiFunction {
+    int variable;
+    int value;
+    // the value from each predecessor of the block, -1 until it is named,
+    // and from the start of the program for the first block
+    std::vector<int> operands;
+};
+
+struct SSAValue {
+    int variable;
+    int instruction;    // the defining instruction, or -1 for a phi function
+    int block;          // the block of the definition, or -1 for the value at the start of the program
+};
+
+class SSAForm {
+public:
+    SSAForm(const IRProgram& program, const ControlFlowGraph& cfg);
+
+    const IRProgram& program;
+    const ControlFlowGraph& cfg;
+
+    std::vector<SSAValue> values;
+    std::vector<std::vector<PhiFunction>> phis;     // the phi functions at the start of each block
+    std::vector<int> defined_value;                 // the value defined by each instruction, or -1
+    std::vector<std::vector<int>> used_values;      // the values read by each instruction as a and b, or -1
+
+    // the variable of an operand, or -1 for an immediate, an element in memory, or anything else
+    int variable_of(IROperand opd) const;
+    // the operand of a variable
+    IROperand operand_of(int variable) const;
+    // whether the slot is an element of an array in memory
+    bool in_memory(int slot) const;
+
+    // the value of every variable at the current point of a walk over the dominator tree:
+    // enter a block before its instructions, step over each of its instructions, and leave it after its subtree
+    std::vector<int> current;
+    void enter(int block);
+    void step(int instruction);
+    void leave();
+    // walk the dominator tree from the first block, with an explicit stack as the tree may be as deep as the
+    // program is long: `visit` each block once it is entered, and `finish` it after its subtree, before leaving it
+    void walk(const std::function<void(int)>& visit, const std::function<void(int)>& finish = nullptr);
+
+private:
+    std::map<int, int> slot_variable;   // the variable of each scalar slot
+    std::vector<int> variable_slot;     // the slot of each variable after the virtual registers
+    std::vector<bool> memory_array;     // whether each array is in memory, in the order of program.arrays
+    std::vector<std::pair<int, int>> undo;  // the variables changed in the walk, with their earlier values
+    std::vector<int> undo_marks;
+
+    void set_current(int variable, int value);
+    void place_phis();
+    void name_values(int block);
+};
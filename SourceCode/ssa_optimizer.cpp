@@ -0,0 +1,468 @@
+/*
+    File: ssa_optimizer.cpp
+    Author: Jiaqi Li
+    The global optimizations over the SSA form of the IR program
+
+    The passes run one after another, each over the SSA form of the code left by the one before.
+
+    Global value numbering walks the dominator tree with a scoped table of the expressions computed in the
+    dominating blocks (Briggs, Cooper and Simpson). A value number is a constant or the first value computed:
+    a copy has the number of its source, and a phi function the number of its operands if they are all the same.
+    An expression of constants is folded, and one already computed is replaced by a copy of the variable holding it,
+    if the variable still holds it there. The loads are only numbered within a block, and a store forgets them.
+
+    Copy propagation makes the instructions read the constant or the variable their operands were copied from,
+    if the variable still holds the value. A variable is never replaced by a virtual register, which would keep
+    the temporary alive longer and stop the emitter from computing it straight into the variable.
+
+    Modulo recognition replaces a - b * (a / b), or a - (a / b) * b, by the remainder of one division, when the
+    operands of the subtraction, the product and the division hold the same values. The division and the product
+    are left to dead code elimination, or to the quotient still needed, which the same div then supplies.
+    A divisor that is a constant is left alone, as the emitter divides by it without div.
+
+    Aggressive dead code elimination takes every definition as dead until it is used by the output, a store,
+    a branch or another live definition, so a variable only used to compute itself is removed as well.
+    The control flow is kept: a loop without any effect still runs.
+*/
+
+#include <map>
+#include <tuple>
+
+#include "ssa_optimizer.h"
+#include "ssa.h"
+
+using namespace std;
+
+namespace {
+
+// a constant, or the first value computed
+struct ValueNumber {
+    bool constant;
+    int32_t value;
+
+    bool operator==(const ValueNumber& other) const {
+        return constant == other.constant && value == other.value;
+    }
+    bool operator!=(const ValueNumber& other) const {
+        return !(*this == other);
+    }
+    bool operator<(const ValueNumber& other) const {
+        return constant != other.constant ? constant < other.constant : value < other.value;
+    }
+};
+
+// whether the instruction computes its result from its operands alone
+bool is_expression(ir_opcode op) {
+    return op <= IR_NEG || op == IR_ELEM_ADDR;
+}
+
+bool is_unary(ir_opcode op) {
+    return op == IR_NOT || op == IR_NEG || op == IR_ELEM_ADDR;
+}
+
+bool is_load(ir_opcode op) {
+    return op == IR_LOAD_ELEM || op == IR_LOAD_PTR;
+}
+
+class ValueNumbering {
+public:
+    ValueNumbering(IRProgram* program, SSAForm* ssa) : code(program->code), ssa(*ssa) {
+        for (int v = 0; v < (int)ssa->values.size(); v++) {
+            number.push_back(ValueNumber{false, v});
+        }
+        next_unknown = ssa->values.size();
+    }
+
+    int run() {
+        if (!ssa.cfg.blocks.empty()) {
+            ssa.walk([this](int block) { visit(block); }, [this](int) { finish(); });
+        }
+        return replaced;
+    }
+
+private:
+    typedef tuple<ir_opcode, ValueNumber, ValueNumber> Expression;
+
+    vector<IRInst>& code;
+    SSAForm& ssa;
+    vector<ValueNumber> number;     // the value number of each value
+    int next_unknown;               // the numbers after the values stand for the elements loaded from memory
+    map<Expression, int> expressions;           // the value computing each expression in the dominating blocks
+    vector<pair<Expression, int>> undo;         // the expressions added in the walk, with their earlier values
+    vector<int> undo_marks;                     // the length of the undo log when each block on the walk was entered
+    map<Expression, int> loads;                 // the value loaded from each element in the current block
+    int replaced = 0;
+
+    ValueNumber operand_number(int instruction, int k) {
+        IROperand opd = k == 0 ? code[instruction].a : code[instruction].b;
+        int used = ssa.used_values[instruction][k];
+        if (opd.kind == OPD_IMM) {
+            return ValueNumber{true, opd.value};
+        }
+        if (used >= 0) {
+            return number[used];
+        }
+        return ValueNumber{false, next_unknown++};
+    }
+
+    // replace the instruction by a copy of the value `leader` if its variable still holds it
+    bool copy_from(int instruction, int leader) {
+        int variable = ssa.values[leader].variable;
+        if (ssa.current[variable] != leader) {
+            return false;
+        }
+        code[instruction] = IRInst{IR_MOV, code[instruction].dst, ssa.operand_of(variable), ir_none()};
+        replaced++;
+        return true;
+    }
+
+    // the number of the value defined by an instruction, replacing it if the value is known
+    ValueNumber number_instruction(int i, int defined) {
+        const IRInst& inst = code[i];
+        if (inst.op == IR_MOV) {
+            return operand_number(i, 0);
+        }
+        if (is_load(inst.op)) {
+            // the element at slot a, by the index or the pointer in b
+            Expression key(inst.op, ValueNumber{true, inst.a.value}, operand_number(i, 1));
+            map<Expression, int>::iterator it = loads.find(key);
+            if (it != loads.end()) {
+                ValueNumber known = number[it->second];
+                if (!copy_from(i, it->second)) {
+                    it->second = defined;
+                }
+                return known;
+            }
+            loads[key] = defined;
+            return ValueNumber{false, defined};
+        }
+        if (!is_expression(inst.op)) {
+            return ValueNumber{false, defined};
+        }
+
+        ValueNumber a = operand_number(i, 0);
+        ValueNumber b = is_unary(inst.op) ? ValueNumber{true, 0} : operand_number(i, 1);
+        int32_t folded;
+        if (a.constant && b.constant && ir_evaluate(inst.op, a.value, b.value, &folded)) {
+            code[i] = IRInst{IR_MOV, inst.dst, ir_imm(folded), ir_none()};
+            replaced++;
+            return ValueNumber{true, folded};
+        }
+        if (ir_is_commutative(inst.op) && b < a) {
+            swap(a, b);
+        }
+        Expression key(inst.op, a, b);
+        map<Expression, int>::iterator it = expressions.find(key);
+        if (it == expressions.end()) {
+            undo.push_back({key, -1});
+            expressions[key] = defined;
+            return ValueNumber{false, defined};
+        }
+        ValueNumber known = number[it->second];
+        if (!copy_from(i, it->second)) {
+            // this one holds the value from now on
+            undo.push_back({key, it->second});
+            it->second = defined;
+        }
+        return known;
+    }
+
+    void visit(int block) {
+        for (const PhiFunction& phi : ssa.phis[block]) {
+            ValueNumber same = ValueNumber{false, phi.value};
+            for (int j = 0; j < (int)phi.operands.size(); j++) {
+                if (phi.operands[j] < 0 || (j > 0 && number[phi.operands[j]] != number[phi.operands[0]])) {
+                    same = ValueNumber{false, phi.value};
+                    break;
+                }
+                same = number[phi.operands[j]];
+            }
+            number[phi.value] = same;
+        }
+
+        undo_marks.push_back(undo.size());
+        loads.clear();
+        for (int i = ssa.cfg.blocks[block].start; i < ssa.cfg.blocks[block].end; i++) {
+            int defined = ssa.defined_value[i];
+            if (defined >= 0) {
+                number[defined] = number_instruction(i, defined);
+            } else if (ir_defines(code[i].op) || code[i].op == IR_STORE_ELEM || code[i].op == IR_STORE_PTR) {
+                // a store to memory
+                loads.clear();
+            }
+            ssa.step(i);
+        }
+    }
+
+    // forget the expressions of a block after its subtree
+    void finish() {
+        while ((int)undo.size() > undo_marks.back()) {
+            if (undo.back().second < 0) {
+                expressions.erase(undo.back().first);
+            } else {
+                expressions[undo.back().first] = undo.back().second;
+            }
+            undo.pop_back();
+        }
+        undo_marks.pop_back();
+    }
+};
+
+class CopyPropagation {
+public:
+    CopyPropagation(IRProgram* program, SSAForm* ssa) : code(program->code), ssa(*ssa) {
+        for (int v = 0; v < (int)ssa->values.size(); v++) {
+            source.push_back(ValueNumber{false, v});
+        }
+    }
+
+    int run() {
+        if (!ssa.cfg.blocks.empty()) {
+            ssa.walk([this](int block) { visit(block); });
+        }
+        return rewritten;
+    }
+
+private:
+    vector<IRInst>& code;
+    SSAForm& ssa;
+    vector<ValueNumber> source;     // the constant or the value each value is a copy of
+    int rewritten = 0;
+
+    void propagate(int instruction, int k) {
+        int used = ssa.used_values[instruction][k];
+        if (used < 0) {
+            return;
+        }
+        IROperand& opd = k == 0 ? code[instruction].a : code[instruction].b;
+        ValueNumber copied = source[used];
+        if (copied.constant) {
+            opd = ir_imm(copied.value);
+            rewritten++;
+            return;
+        }
+        const SSAValue& value = ssa.values[copied.value];
+        IROperand holder = ssa.operand_of(value.variable);
+        if (copied.value == used || ssa.current[value.variable] != copied.value) {
+            return;
+        }
+        if (holder.kind == OPD_VREG && opd.kind != OPD_VREG) {
+            return;
+        }
+        opd = holder;
+        rewritten++;
+    }
+
+    void visit(int block) {
+        for (const PhiFunction& phi : ssa.phis[block]) {
+            ValueNumber same = ValueNumber{false, phi.value};
+            for (int j = 0; j < (int)phi.operands.size(); j++) {
+                if (phi.operands[j] < 0 || (j > 0 && source[phi.operands[j]] != source[phi.operands[0]])) {
+                    same = ValueNumber{false, phi.value};
+                    break;
+                }
+                same = source[phi.operands[j]];
+            }
+            source[phi.value] = same;
+        }
+
+        for (int i = ssa.cfg.blocks[block].start; i < ssa.cfg.blocks[block].end; i++) {
+            int used = ssa.used_values[i][0];
+            int defined = ssa.defined_value[i];
+            if (defined >= 0 && code[i].op == IR_MOV) {
+                source[defined] = code[i].a.kind == OPD_IMM ? ValueNumber{true, code[i].a.value}
+                                : used >= 0 ? source[used] : ValueNumber{false, defined};
+            }
+            propagate(i, 0);
+            propagate(i, 1);
+            ssa.step(i);
+        }
+
+    }
+};
+
+class ModuloRecognition {
+public:
+    ModuloRecognition(IRProgram* program, SSAForm* ssa) : code(program->code), ssa(*ssa) {}
+
+    int run() {
+        if (!ssa.cfg.blocks.empty()) {
+            ssa.walk([this](int block) { visit(block); });
+        }
+        return recognized;
+    }
+
+private:
+    vector<IRInst>& code;
+    SSAForm& ssa;
+    int recognized = 0;
+
+    static IROperand operand(const IRInst& inst, int k) {
+        return k == 0 ? inst.a : inst.b;
+    }
+
+    // whether operand k of instruction i and operand l of instruction j hold the same value
+    bool same_value(int i, int k, int j, int l) const {
+        IROperand x = operand(code[i], k), y = operand(code[j], l);
+        if (x.kind == OPD_IMM || y.kind == OPD_IMM) {
+            return x == y;
+        }
+        int value = ssa.used_values[i][k];
+        return value >= 0 && value == ssa.used_values[j][l];
+    }
+
+    // the instruction computing the value read by operand k of instruction i, through copies, or -1
+    int definition(int i, int k) const {
+        int value = ssa.used_values[i][k];
+        int defining = value >= 0 ? ssa.values[value].instruction : -1;
+        while (defining >= 0 && code[defining].op == IR_MOV && ssa.used_values[defining][0] >= 0) {
+            defining = ssa.values[ssa.used_values[defining][0]].instruction;
+        }
+        return defining;
+    }
+
+    // whether operand k of instruction i still holds its value at the current point of the walk
+    bool available(int i, int k) const {
+        IROperand opd = operand(code[i], k);
+        return opd.kind == OPD_IMM || ssa.current[ssa.variable_of(opd)] == ssa.used_values[i][k];
+    }
+
+    // the remainder for the subtraction at i, if it is a - b * (a / b)
+    void recognize(int i) {
+        int product = definition(i, 1);
+        if (product < 0 || code[product].op != IR_MUL) {
+            return;
+        }
+        for (int k = 0; k < 2; k++) {
+            int quotient = definition(product, k);
+            if (quotient < 0 || code[quotient].op != IR_DIV || code[quotient].b.kind == OPD_IMM
+                || !same_value(i, 0, quotient, 0) || !same_value(product, 1 - k, quotient, 1)) {
+                continue;
+            }
+            IROperand divisor;
+            if (available(quotient, 1)) {
+                divisor = code[quotient].b;
+            } else if (available(product, 1 - k)) {
+                divisor = operand(code[product], 1 - k);
+            } else {
+                continue;
+            }
+            code[i] = IRInst{IR_REM, code[i].dst, code[i].a, divisor};
+            recognized++;
+            return;
+        }
+    }
+
+    void visit(int block) {
+        for (int i = ssa.cfg.blocks[block].start; i < ssa.cfg.blocks[block].end; i++) {
+            if (code[i].op == IR_SUB) {
+                recognize(i);
+            }
+            ssa.step(i);
+        }
+    }
+};
+
+class DeadCodeElimination {
+public:
+    DeadCodeElimination(IRProgram* program, SSAForm* ssa) : code(program->code), ssa(*ssa) {}
+
+    int run() {
+        live_value.assign(ssa.values.size(), false);
+        live_instruction.assign(code.size(), false);
+        for (int b = 0; b < (int)ssa.phis.size(); b++) {
+            for (const PhiFunction& phi : ssa.phis[b]) {
+                phi_operands[phi.value] = &phi.operands;
+            }
+        }
+
+        // the instructions with effects, and those not reached, which have no values
+        vector<bool> reachable(ssa.cfg.blocks.size(), false);
+        for (int b : ssa.cfg.reverse_postorder) {
+            reachable[b] = true;
+        }
+        for (int i = 0; i < (int)code.size(); i++) {
+            if (ssa.defined_value[i] < 0 || code[i].op == IR_READ || !reachable[ssa.cfg.block_of[i]]) {
+                mark_instruction(i);
+            }
+        }
+        while (!pending.empty()) {
+            int value = pending.back();
+            pending.pop_back();
+            if (ssa.values[value].instruction >= 0) {
+                mark_instruction(ssa.values[value].instruction);
+            } else if (phi_operands.count(value)) {
+                for (int operand : *phi_operands[value]) {
+                    mark_value(operand);
+                }
+            }
+        }
+
+        vector<IRInst> kept;
+        int removed = 0;
+        for (int i = 0; i < (int)code.size(); i++) {
+            if (live_instruction[i]) {
+                kept.push_back(code[i]);
+            } else {
+                removed++;
+            }
+        }
+        code.swap(kept);
+        return removed;
+    }
+
+private:
+    vector<IRInst>& code;
+    SSAForm& ssa;
+    vector<bool> live_value;
+    vector<bool> live_instruction;
+    map<int, const vector<int>*> phi_operands;     // the operands of each phi function, by its value
+    vector<int> pending;    // the values found live, whose definitions are not marked yet
+
+    void mark_value(int value) {
+        if (value >= 0 && !live_value[value]) {
+            live_value[value] = true;
+            pending.push_back(value);
+        }
+    }
+
+    void mark_instruction(int instruction) {
+        if (!live_instruction[instruction]) {
+            live_instruction[instruction] = true;
+            mark_value(ssa.used_values[instruction][0]);
+            mark_value(ssa.used_values[instruction][1]);
+        }
+    }
+};
+
+}
+
+void optimize_ssa(IRProgram* program, ostream* stats) {
+    int replaced, rewritten, remainders, removed;
+    {
+        ControlFlowGraph cfg(program->code);
+        SSAForm ssa(*program, cfg);
+        replaced = ValueNumbering(program, &ssa).run();
+    }
+    {
+        ControlFlowGraph cfg(program->code);
+        SSAForm ssa(*program, cfg);
+        rewritten = CopyPropagation(program, &ssa).run();
+    }
+    {
+        ControlFlowGraph cfg(program->code);
+        SSAForm ssa(*program, cfg);
+        remainders = ModuloRecognition(program, &ssa).run();
+    }
+    {
+        ControlFlowGraph cfg(program->code);
+        SSAForm ssa(*program, cfg);
+        removed = DeadCodeElimination(program, &ssa).run();
+    }
+    if (stats) {
+        *stats << "ssa: value numbering replaced " << replaced << " instructions by copies\n";
+        *stats << "ssa: copy propagation rewrote " << rewritten << " operands\n";
+        *stats << "ssa: modulo recognition replaced " << remainders << " subtractions by remainders\n";
+        *stats << "ssa: dead code elimination removed " << removed << " instructions\n";
+    }
+}
@@ -0,0 +1,16 @@
+/*
+    File: ssa_optimizer.h
+    Author: Jiaqi Li
+    The global optimizations over the SSA form of the IR program, run between the semantic routines and the MIPS emitter.
+*/
+
+#pragma once
+
+#include <iostream>
+
+#include "ir.h"
+
+// run global value numbering, copy propagation, modulo recognition and aggressive dead code elimination
+// over the program
+// the number of instructions changed by each pass is printed to `stats` if given
+void optimize_ssa(IRProgram* program, std::ostream* stats = nullptr);
@@ -0,0 +1,106 @@
+/*
+    File: token_ring.h
+    Author: Jiaqi Li
+    A single-producer/single-consumer lock-free ring buffer of scanned tokens.
+
+    It is used by the pipelined mode, where the scanner runs on its own thread and
+    the parser consumes the tokens concurrently.
+    The producer publishes tokens in batches; it waits when the ring is full (backpressure).
+    The producer closes the ring at the end of input, and the consumer cancels it when it stops early.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+class TokenRing {
+public:
+    static const size_t capacity = 1 << 12;    // number of slots, must be a power of two
+    static const size_t batch_size = 64;       // number of tokens published at once
+
+    // producer side: append a token, the semantic value is moved into the ring
+    // returns false if the consumer has cancelled
+    bool push(int token, std::string& semantic_value) {
+        while (pending_tail - cached_head == capacity) {
+            // ring is full, make the pending tokens visible and wait for the consumer
+            publish();
+            cached_head = head.load(std::memory_order_acquire);
+            if (pending_tail - cached_head == capacity) {
+                if (cancelled.load(std::memory_order_acquire)) {
+                    return false;
+                }
+                std::this_thread::yield();
+            }
+        }
+        Slot& slot = slots[pending_tail & (capacity - 1)];
+        slot.token = token;
+        slot.semantic_value.swap(semantic_value);
+        pending_tail++;
+        if (pending_tail - tail.load(std::memory_order_relaxed) >= batch_size) {
+            publish();
+        }
+        return !cancelled.load(std::memory_order_relaxed);
+    }
+
+    // producer side: publish the remaining tokens and mark the end of input
+    void close() {
+        publish();
+        closed.store(true, std::memory_order_release);
+    }
+
+    // consumer side: take the next token, waiting for the producer if necessary
+    // returns false once the ring is closed and drained
+    bool pop(int* token, std::string* semantic_value) {
+        size_t curr_head = head.load(std::memory_order_relaxed);
+        while (curr_head == cached_tail) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (curr_head != cached_tail) {
+                break;
+            }
+            if (closed.load(std::memory_order_acquire)) {
+                // the tail is final once closed is seen
+                cached_tail = tail.load(std::memory_order_acquire);
+                if (curr_head == cached_tail) {
+                    return false;
+                }
+                break;
+            }
+            std::this_thread::yield();
+        }
+        Slot& slot = slots[curr_head & (capacity - 1)];
+        *token = slot.token;
+        semantic_value->swap(slot.semantic_value);
+        head.store(curr_head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side: stop the producer, e.g. on a parsing error
+    void cancel() {
+        cancelled.store(true, std::memory_order_release);
+    }
+
+private:
+    struct Slot {
+        int token;
+        std::string semantic_value;
+    };
+    Slot slots[capacity];
+
+    // shared indices, on separate cache lines to avoid false sharing
+    alignas(64) std::atomic<size_t> head{0};   // next slot to be consumed
+    alignas(64) std::atomic<size_t> tail{0};   // end of the published slots
+    alignas(64) std::atomic<bool> closed{false};
+    std::atomic<bool> cancelled{false};
+
+    // producer-local
+    alignas(64) size_t pending_tail = 0;    // end of the written slots, including unpublished ones
+    size_t cached_head = 0;
+    // consumer-local
+    alignas(64) size_t cached_tail = 0;
+
+    void publish() {
+        tail.store(pending_tail, std::memory_order_release);
+    }
+};